@@ -98,6 +98,7 @@ cmd_capture_pane_exec(struct cmd *self, struct cmd_ctx *ctx)
 
 	       free(line);
 	}
+	grid_compress_history(gd);
 
 	limit = options_get_number(&global_options, "buffer-limit");
 
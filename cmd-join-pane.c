@@ -144,6 +144,7 @@ join_pane(struct cmd *self, struct cmd_ctx *ctx, int not_same_window)
 			src_w->active = TAILQ_NEXT(src_wp, entry);
 	}
 	TAILQ_REMOVE(&src_w->panes, src_wp, entry);
+	window_map_invalidate(src_w);
 
 	if (window_count_panes(src_w) == 0)
 		server_kill_window(src_w);
@@ -148,15 +148,27 @@ cmd_set_option_exec(struct cmd *self, struct cmd_ctx *ctx)
 			return (CMD_RETURN_ERROR);
 	}
 
-	/* Start or stop timers when automatic-rename changed. */
+	/* Queue windows for naming when automatic-rename changed. */
 	if (strcmp (oe->name, "automatic-rename") == 0) {
 		for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
 			if ((w = ARRAY_ITEM(&windows, i)) == NULL)
 				continue;
 			if (options_get_number(&w->options, "automatic-rename"))
 				queue_window_name(w);
-			else if (event_initialized(&w->name_timer))
-				evtimer_del(&w->name_timer);
+		}
+	}
+
+	/*
+	 * Start or stop silence timers when monitor-silence changed, in the
+	 * window it was set for or those using the global value.
+	 */
+	if (strcmp(oe->name, "monitor-silence") == 0) {
+		for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
+			if ((w = ARRAY_ITEM(&windows, i)) == NULL)
+				continue;
+			if (oo == &w->options || (oo == &global_w_options &&
+			    options_find1(&w->options, oe->name) == NULL))
+				server_window_reset_silence(w);
 		}
 	}
 
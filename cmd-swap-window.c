@@ -67,8 +67,12 @@ cmd_swap_window_exec(struct cmd *self, struct cmd_ctx *ctx)
 		return (CMD_RETURN_NORMAL);
 
 	w = wl_dst->window;
+	TAILQ_REMOVE(&w->winlinks, wl_dst, wentry);
+	TAILQ_REMOVE(&wl_src->window->winlinks, wl_src, wentry);
 	wl_dst->window = wl_src->window;
 	wl_src->window = w;
+	TAILQ_INSERT_TAIL(&wl_dst->window->winlinks, wl_dst, wentry);
+	TAILQ_INSERT_TAIL(&w->winlinks, wl_src, wentry);
 
 	if (!args_has(self->args, 'd')) {
 		session_select(dst, wl_dst->idx);
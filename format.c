@@ -308,6 +308,9 @@ format_client(struct format_tree *ft, struct client *c)
 	format_add(ft, "client_width", "%u", c->tty.sx);
 	format_add(ft, "client_tty", "%s", c->tty.path);
 	format_add(ft, "client_termname", "%s", c->tty.termname);
+	format_add(ft, "client_dropped", "%u", c->tty.dropped);
+	format_add(ft, "client_redraws", "%u", c->tty.redraws);
+	format_add(ft, "client_frames", "%u", c->tty.frames);
 
 	t = c->creation_time.tv_sec;
 	format_add(ft, "client_created", "%ld", (long) t);
@@ -361,16 +364,18 @@ void
 format_window_pane(struct format_tree *ft, struct window_pane *wp)
 {
 	struct grid		*gd = wp->base.grid;
-	struct grid_line	*gl;
+	const struct grid_line	*gl;
 	unsigned long long	 size;
 	u_int			 i;
 	u_int			 idx;
 
 	size = 0;
 	for (i = 0; i < gd->hsize; i++) {
-		gl = &gd->linedata[i];
-		size += gl->cellsize * sizeof *gl->celldata;
-		size += gl->utf8size * sizeof *gl->utf8data;
+		gl = grid_peek_line(gd, i);
+		if (gl->flags & GRID_LINE_PACKED)
+			size += grid_packed_size(gl);
+		else
+			size += gl->cellsize * sizeof *gl->celldata;
 	}
 	size += gd->hsize * sizeof *gd->linedata;
 
@@ -384,6 +389,9 @@ format_window_pane(struct format_tree *ft, struct window_pane *wp)
 	format_add(ft, "history_size", "%u", gd->hsize);
 	format_add(ft, "history_limit", "%u", gd->hlimit);
 	format_add(ft, "history_bytes", "%llu", size);
+	format_add(ft, "history_compressed_bytes", "%zu", gd->hcompressed);
+	format_add(ft, "history_uncompressed_bytes", "%zu",
+	    gd->huncompressed);
 	format_add(ft, "pane_id", "%%%u", wp->id);
 	format_add(ft, "pane_active", "%d", wp == wp->window->active);
 	format_add(ft, "pane_dead", "%d", wp->fd == -1);
@@ -0,0 +1,702 @@
+/* $Id$ */
+
+/*
+ * Copyright (c) 2013 Nicholas Marriott <nicm@users.sourceforge.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmux.h"
+
+/*
+ * Packed and compressed grid lines.
+ *
+ * Lines in the history are no longer written to, so when a line is scrolled
+ * into the history it is packed (GRID_LINE_PACKED). Rather than an array of
+ * cells, the attributes are stored as runs of cells which share the same
+ * attributes, flags and colours, followed by the character data as a string of
+ * bytes: plain cells are one byte and UTF-8 cells their UTF-8 sequence, or an
+ * escape and an index for entries in the UTF-8 table. For most lines the
+ * character data is just the text of the line, so it may be copied or searched
+ * without unpacking the line.
+ *
+ * History lines older than the hot limit are also compressed
+ * (GRID_LINE_COMPRESSED) with a simple LZ77 compressor.
+ *
+ * The data starts with the size of the packed line and, if it is compressed,
+ * the size of the compressed data.
+ */
+
+/* Parsed packed line. */
+struct grid_packed {
+	u_int		 cellsize;
+	u_int		 nruns;
+	const u_char	*runs;
+	const u_char	*text;
+	const u_char	*end;
+};
+
+/* Escape for cells holding a UTF-8 table index. */
+#define GRID_PACKED_TABLE 0xff
+
+/* Compressor parameters. */
+#define GRID_COMPRESS_MINMATCH 4
+#define GRID_COMPRESS_MAXOFFSET 65535
+#define GRID_COMPRESS_HASHBITS 10
+
+u_char	*grid_compress_buf;
+size_t	 grid_compress_bufsize;
+u_char	*grid_compress_buf2;
+size_t	 grid_compress_buf2size;
+
+u_char	*grid_compress_ensure(u_char **, size_t *, size_t);
+size_t	 grid_compress_put_number(u_char *, u_int);
+u_int	 grid_compress_get_number(const u_char **, const u_char *);
+size_t	 grid_pack_cells(const struct grid_cell *, u_int, u_char *);
+u_int	 grid_unpack_cell(const u_char **, const u_char *, int);
+size_t	 grid_pack(const struct grid_line *, u_char *);
+void	 grid_packed_parse(struct grid_packed *, const u_char *, size_t);
+void	 grid_unpack(struct grid_line *, const u_char *, size_t);
+size_t	 grid_compress_length(u_char *, size_t);
+size_t	 grid_compress_bytes(const u_char *, size_t, u_char *);
+void	 grid_uncompress_bytes(const u_char *, size_t, u_char *, size_t);
+size_t	 grid_packed_header(const struct grid_line *, size_t *, size_t *);
+const u_char *grid_packed_data(const struct grid_line *, size_t *);
+
+/* Make sure a scratch buffer is big enough. */
+u_char *
+grid_compress_ensure(u_char **buf, size_t *bufsize, size_t size)
+{
+	if (size > *bufsize) {
+		*buf = xrealloc(*buf, 1, size);
+		*bufsize = size;
+	}
+	return (*buf);
+}
+
+/* Store a number, seven bits at a time. */
+size_t
+grid_compress_put_number(u_char *out, u_int n)
+{
+	size_t	off = 0;
+
+	while (n >= 0x80) {
+		out[off++] = (n & 0x7f) | 0x80;
+		n >>= 7;
+	}
+	out[off++] = n;
+	return (off);
+}
+
+/* Read a number stored by grid_compress_put_number. */
+u_int
+grid_compress_get_number(const u_char **in, const u_char *end)
+{
+	u_int	n = 0, shift = 0;
+
+	for (;;) {
+		if (*in == end || shift > 28)
+			fatalx("bad packed line");
+		n |= (u_int) (**in & 0x7f) << shift;
+		if (!(*(*in)++ & 0x80))
+			break;
+		shift += 7;
+	}
+	return (n);
+}
+
+/*
+ * Store the character data of a set of cells. The output buffer must have
+ * space for at least 16 bytes per cell.
+ */
+size_t
+grid_pack_cells(const struct grid_cell *gc, u_int n, u_char *out)
+{
+	size_t	off = 0;
+
+	for (; n > 0; n--, gc++) {
+		if (!(gc->flags & GRID_FLAG_UTF8))
+			out[off++] = gc->data;
+		else if (gc->data >= GRID_UTF8_TABLE) {
+			out[off++] = GRID_PACKED_TABLE;
+			off += grid_compress_put_number(out + off,
+			    gc->data - GRID_UTF8_TABLE);
+		} else if (gc->data < 0x80)
+			out[off++] = gc->data;
+		else if (gc->data < 0x800) {
+			out[off++] = 0xc0 | (gc->data >> 6);
+			out[off++] = 0x80 | (gc->data & 0x3f);
+		} else if (gc->data < 0x10000) {
+			out[off++] = 0xe0 | (gc->data >> 12);
+			out[off++] = 0x80 | ((gc->data >> 6) & 0x3f);
+			out[off++] = 0x80 | (gc->data & 0x3f);
+		} else {
+			out[off++] = 0xf0 | (gc->data >> 18);
+			out[off++] = 0x80 | ((gc->data >> 12) & 0x3f);
+			out[off++] = 0x80 | ((gc->data >> 6) & 0x3f);
+			out[off++] = 0x80 | (gc->data & 0x3f);
+		}
+	}
+	return (off);
+}
+
+/* Read the character data of one cell stored by grid_pack_cells. */
+u_int
+grid_unpack_cell(const u_char **text, const u_char *end, int utf8)
+{
+	const u_char	*p = *text;
+	u_int		 data;
+
+	if (p == end)
+		fatalx("bad packed line");
+	if (!utf8 || *p < 0x80) {
+		*text = p + 1;
+		return (*p);
+	}
+	if (*p == GRID_PACKED_TABLE) {
+		*text = p + 1;
+		return (GRID_UTF8_TABLE + grid_compress_get_number(text, end));
+	}
+	if (*p < 0xe0) {
+		if (end - p < 2)
+			fatalx("bad packed line");
+		data = (p[0] & 0x1f) << 6 | (p[1] & 0x3f);
+		*text = p + 2;
+	} else if (*p < 0xf0) {
+		if (end - p < 3)
+			fatalx("bad packed line");
+		data = (p[0] & 0x0f) << 12 | (p[1] & 0x3f) << 6 | (p[2] & 0x3f);
+		*text = p + 3;
+	} else {
+		if (end - p < 4)
+			fatalx("bad packed line");
+		data = (p[0] & 0x07) << 18 | (p[1] & 0x3f) << 12 |
+		    (p[2] & 0x3f) << 6 | (p[3] & 0x3f);
+		*text = p + 4;
+	}
+	return (data);
+}
+
+/*
+ * Pack the cells of a line into attribute runs and character data. The output
+ * buffer must have space for at least 16 bytes per cell plus 16.
+ */
+size_t
+grid_pack(const struct grid_line *gl, u_char *out)
+{
+	const struct grid_cell	*gc, *start;
+	size_t			 off;
+	u_int			 xx, n, nruns;
+
+	/* Count the attribute runs. */
+	nruns = 0;
+	for (xx = 0; xx < gl->cellsize; xx++) {
+		gc = &gl->celldata[xx];
+		if (xx == 0 || memcmp(gc, gc - 1, 4) != 0)
+			nruns++;
+	}
+
+	off = grid_compress_put_number(out, gl->cellsize);
+	off += grid_compress_put_number(out + off, nruns);
+
+	/* Write the runs. */
+	for (xx = 0; xx < gl->cellsize; xx += n) {
+		start = &gl->celldata[xx];
+		for (n = 1; xx + n < gl->cellsize; n++) {
+			if (memcmp(start, start + n, 4) != 0)
+				break;
+		}
+		off += grid_compress_put_number(out + off, n);
+		out[off++] = start->attr;
+		out[off++] = start->flags;
+		out[off++] = start->fg;
+		out[off++] = start->bg;
+	}
+
+	/* Then the character data. */
+	return (off + grid_pack_cells(gl->celldata, gl->cellsize, out + off));
+}
+
+/* Find the runs and character data of a packed line. */
+void
+grid_packed_parse(struct grid_packed *gp, const u_char *in, size_t size)
+{
+	const u_char	*end = in + size;
+	u_int		 i;
+
+	gp->cellsize = grid_compress_get_number(&in, end);
+	gp->nruns = grid_compress_get_number(&in, end);
+	gp->runs = in;
+	for (i = 0; i < gp->nruns; i++) {
+		grid_compress_get_number(&in, end);
+		if (end - in < 4)
+			fatalx("bad packed line");
+		in += 4;
+	}
+	gp->text = in;
+	gp->end = end;
+}
+
+/* Unpack a line packed by grid_pack into its cells. */
+void
+grid_unpack(struct grid_line *gl, const u_char *in, size_t size)
+{
+	struct grid_packed	 gp;
+	struct grid_cell	*gc;
+	const u_char		*runs, *text;
+	u_int			 n, xx, i;
+
+	grid_packed_parse(&gp, in, size);
+	if (gp.cellsize != gl->cellsize)
+		fatalx("bad packed line");
+	gl->celldata = xcalloc(gp.cellsize, sizeof *gl->celldata);
+
+	runs = gp.runs;
+	text = gp.text;
+	xx = 0;
+	for (i = 0; i < gp.nruns; i++) {
+		n = grid_compress_get_number(&runs, gp.text);
+		if (n > gp.cellsize - xx)
+			fatalx("bad packed line");
+		for (; n > 0; n--, xx++) {
+			gc = &gl->celldata[xx];
+			gc->attr = runs[0];
+			gc->flags = runs[1];
+			gc->fg = runs[2];
+			gc->bg = runs[3];
+			gc->data = grid_unpack_cell(&text, gp.end,
+			    gc->flags & GRID_FLAG_UTF8);
+		}
+		runs += 4;
+	}
+	if (xx != gp.cellsize)
+		fatalx("bad packed line");
+}
+
+/* Store a literal or match length continuation (after the first 15). */
+size_t
+grid_compress_length(u_char *out, size_t len)
+{
+	size_t	off = 0;
+
+	for (; len >= 255; len -= 255)
+		out[off++] = 255;
+	out[off++] = len;
+	return (off);
+}
+
+/*
+ * Compress a buffer. The output is a series of sequences, each a token byte
+ * with the literal length in the top four bits and the match length (less the
+ * minimum) in the bottom four; longer lengths continue in the following bytes.
+ * Then come the literals and a two byte offset back to the match. The last
+ * sequence has only literals. The output buffer must be at least the input
+ * size plus a 255th of it plus 16 bytes.
+ */
+size_t
+grid_compress_bytes(const u_char *in, size_t size, u_char *out)
+{
+	u_int	 table[1 << GRID_COMPRESS_HASHBITS];
+	size_t	 off, ip, anchor, ref, len, litlen;
+	u_int	 value, hash;
+	u_char	*token;
+
+	memset(table, 0, sizeof table);
+
+	off = ip = anchor = 0;
+	while (ip + GRID_COMPRESS_MINMATCH <= size) {
+		memcpy(&value, in + ip, sizeof value);
+		hash = (value * 2654435761U) >> (32 - GRID_COMPRESS_HASHBITS);
+		ref = table[hash];
+		table[hash] = ip + 1;
+		if (ref == 0 || ip - (ref - 1) > GRID_COMPRESS_MAXOFFSET ||
+		    memcmp(in + ref - 1, in + ip,
+		    GRID_COMPRESS_MINMATCH) != 0) {
+			ip++;
+			continue;
+		}
+		ref--;
+
+		len = GRID_COMPRESS_MINMATCH;
+		while (ip + len < size && in[ref + len] == in[ip + len])
+			len++;
+
+		token = &out[off++];
+		litlen = ip - anchor;
+		if (litlen >= 15) {
+			*token = 15 << 4;
+			off += grid_compress_length(out + off, litlen - 15);
+		} else
+			*token = litlen << 4;
+		memcpy(out + off, in + anchor, litlen);
+		off += litlen;
+
+		out[off++] = (ip - ref) & 0xff;
+		out[off++] = (ip - ref) >> 8;
+		if (len - GRID_COMPRESS_MINMATCH >= 15) {
+			*token |= 15;
+			off += grid_compress_length(out + off,
+			    len - GRID_COMPRESS_MINMATCH - 15);
+		} else
+			*token |= len - GRID_COMPRESS_MINMATCH;
+
+		ip += len;
+		anchor = ip;
+	}
+
+	/* Last literals. */
+	token = &out[off++];
+	litlen = size - anchor;
+	if (litlen >= 15) {
+		*token = 15 << 4;
+		off += grid_compress_length(out + off, litlen - 15);
+	} else
+		*token = litlen << 4;
+	memcpy(out + off, in + anchor, litlen);
+	off += litlen;
+
+	return (off);
+}
+
+/* Uncompress a buffer compressed by grid_compress_bytes. */
+void
+grid_uncompress_bytes(const u_char *in, size_t size, u_char *out,
+    size_t outsize)
+{
+	const u_char	*end = in + size;
+	size_t		 off, len, offset;
+	u_char		 token;
+
+	off = 0;
+	for (;;) {
+		if (in == end)
+			fatalx("bad compressed line");
+		token = *in++;
+
+		len = token >> 4;
+		if (len == 15) {
+			do {
+				if (in == end)
+					fatalx("bad compressed line");
+				len += *in;
+			} while (*in++ == 255);
+		}
+		if (len > (size_t) (end - in) || len > outsize - off)
+			fatalx("bad compressed line");
+		memcpy(out + off, in, len);
+		in += len;
+		off += len;
+
+		if (in == end)
+			break;
+
+		if (end - in < 2)
+			fatalx("bad compressed line");
+		offset = in[0] | in[1] << 8;
+		in += 2;
+		len = token & 0xf;
+		if (len == 15) {
+			do {
+				if (in == end)
+					fatalx("bad compressed line");
+				len += *in;
+			} while (*in++ == 255);
+		}
+		len += GRID_COMPRESS_MINMATCH;
+		if (offset == 0 || offset > off || len > outsize - off)
+			fatalx("bad compressed line");
+
+		/* Matches may overlap so copy a byte at a time. */
+		for (; len > 0; len--, off++)
+			out[off] = out[off - offset];
+	}
+	if (off != outsize)
+		fatalx("bad compressed line");
+}
+
+/* Read the header of a packed line. Returns the header size. */
+size_t
+grid_packed_header(const struct grid_line *gl, size_t *packedsize,
+    size_t *size)
+{
+	const u_char	*in = gl->packed;
+
+	*packedsize = grid_compress_get_number(&in, gl->packed + 5);
+	if (gl->flags & GRID_LINE_COMPRESSED)
+		*size = grid_compress_get_number(&in, in + 5);
+	else
+		*size = *packedsize;
+	return (in - gl->packed);
+}
+
+/* Get the packed data of a line, uncompressing it if needed. */
+const u_char *
+grid_packed_data(const struct grid_line *gl, size_t *packedsize)
+{
+	u_char	*out;
+	size_t	 hdrsize, size;
+
+	hdrsize = grid_packed_header(gl, packedsize, &size);
+	if (!(gl->flags & GRID_LINE_COMPRESSED))
+		return (gl->packed + hdrsize);
+
+	out = grid_compress_ensure(&grid_compress_buf,
+	    &grid_compress_bufsize, *packedsize);
+	grid_uncompress_bytes(gl->packed + hdrsize, size, out, *packedsize);
+	return (out);
+}
+
+/* Pack a line, freeing its cells. */
+void
+grid_pack_line(struct grid_line *gl)
+{
+	u_char	*out;
+	size_t	 packedsize, hdrsize;
+
+	if (gl->celldata == NULL || gl->flags & GRID_LINE_PACKED)
+		return;
+	if (gl->cellsize == 0) {
+		free(gl->celldata);
+		gl->celldata = NULL;
+		return;
+	}
+
+	out = grid_compress_ensure(&grid_compress_buf,
+	    &grid_compress_bufsize, gl->cellsize * 16 + 16);
+	packedsize = grid_pack(gl, out);
+
+	free(gl->celldata);
+	gl->celldata = NULL;
+
+	hdrsize = grid_compress_put_number(out + packedsize, packedsize);
+	gl->packed = xmalloc(hdrsize + packedsize);
+	memcpy(gl->packed, out + packedsize, hdrsize);
+	memcpy(gl->packed + hdrsize, out, packedsize);
+	gl->flags |= GRID_LINE_PACKED;
+}
+
+/* Pack and compress a line. */
+void
+grid_compress_line(struct grid *gd, struct grid_line *gl)
+{
+	u_char	*out;
+	size_t	 packedsize, size, hdrsize;
+
+	if (gl->flags & GRID_LINE_COMPRESSED)
+		return;
+	grid_pack_line(gl);
+	if (!(gl->flags & GRID_LINE_PACKED))
+		return;
+
+	/* Compress after space for the header, then fill it in. */
+	hdrsize = grid_packed_header(gl, &packedsize, &size);
+	out = grid_compress_ensure(&grid_compress_buf2,
+	    &grid_compress_buf2size, 10 + packedsize + packedsize / 255 + 16);
+	size = grid_compress_bytes(gl->packed + hdrsize, packedsize, out + 10);
+	hdrsize = grid_compress_put_number(out, packedsize);
+	hdrsize += grid_compress_put_number(out + hdrsize, size);
+
+	free(gl->packed);
+	gl->packed = xmalloc(hdrsize + size);
+	memcpy(gl->packed, out, hdrsize);
+	memcpy(gl->packed + hdrsize, out + 10, size);
+	gl->flags |= GRID_LINE_COMPRESSED;
+
+	gd->hcompressed += hdrsize + size;
+	gd->huncompressed += gl->cellsize * sizeof *gl->celldata;
+}
+
+/* Unpack a line back into cells. */
+void
+grid_unpack_line(struct grid *gd, struct grid_line *gl)
+{
+	const u_char	*data;
+	size_t		 packedsize;
+
+	if (!(gl->flags & GRID_LINE_PACKED))
+		return;
+
+	data = grid_packed_data(gl, &packedsize);
+	grid_unpack(gl, data, packedsize);
+
+	grid_free_packed(gd, gl);
+}
+
+/* Free a packed line. */
+void
+grid_free_packed(struct grid *gd, struct grid_line *gl)
+{
+	size_t	packedsize, size, hdrsize;
+
+	if (!(gl->flags & GRID_LINE_PACKED))
+		return;
+
+	if (gl->flags & GRID_LINE_COMPRESSED) {
+		hdrsize = grid_packed_header(gl, &packedsize, &size);
+		gd->hcompressed -= hdrsize + size;
+		gd->huncompressed -= gl->cellsize * sizeof *gl->celldata;
+	}
+
+	free(gl->packed);
+	gl->packed = NULL;
+	gl->flags &= ~(GRID_LINE_PACKED|GRID_LINE_COMPRESSED);
+}
+
+/* Get the memory used by a packed line. */
+size_t
+grid_packed_size(const struct grid_line *gl)
+{
+	size_t	packedsize, size;
+
+	return (grid_packed_header(gl, &packedsize, &size) + size);
+}
+
+/*
+ * Convert cells of a packed line into a string, like grid_string_cells. Runs
+ * of plain cells are copied straight from the character data.
+ */
+char *
+grid_packed_string(const struct grid_line *gl, u_int px, u_int nx)
+{
+	struct grid_packed	 gp;
+	struct grid_cell	 gc;
+	struct grid_utf8	 gu;
+	const u_char		*data, *runs, *text, *start;
+	char			*buf;
+	size_t			 packedsize, off;
+	u_int			 xx, n, first, last, i;
+
+	data = grid_packed_data(gl, &packedsize);
+	grid_packed_parse(&gp, data, packedsize);
+
+	/* Cells past the end of the line are spaces which would be trimmed. */
+	if (px > gp.cellsize)
+		px = gp.cellsize;
+	if (nx > gp.cellsize - px)
+		nx = gp.cellsize - px;
+	buf = xmalloc(nx * UTF8_SIZE + 1);
+	off = 0;
+
+	runs = gp.runs;
+	text = gp.text;
+	xx = 0;
+	for (i = 0; i < gp.nruns && xx < px + nx; i++) {
+		n = grid_compress_get_number(&runs, gp.text);
+		gc.flags = runs[1];
+		runs += 4;
+
+		if (!(gc.flags & (GRID_FLAG_UTF8|GRID_FLAG_PADDING))) {
+			/* Plain cells are one byte each. */
+			if (n > (size_t) (gp.end - text))
+				fatalx("bad packed line");
+			first = xx < px ? px - xx : 0;
+			last = px + nx - xx < n ? px + nx - xx : n;
+			if (first < last) {
+				memcpy(buf + off, text + first, last - first);
+				off += last - first;
+			}
+			text += n;
+			xx += n;
+			continue;
+		}
+
+		for (; n > 0 && xx < px + nx; n--, xx++) {
+			start = text;
+			gc.data = grid_unpack_cell(&text, gp.end,
+			    gc.flags & GRID_FLAG_UTF8);
+			if (xx < px || gc.flags & GRID_FLAG_PADDING)
+				continue;
+			if (!(gc.flags & GRID_FLAG_UTF8))
+				buf[off++] = gc.data;
+			else if (gc.data < GRID_UTF8_TABLE) {
+				memcpy(buf + off, start, text - start);
+				off += text - start;
+			} else {
+				grid_utf8_get(&gc, &gu);
+				off += grid_utf8_copy(&gu, buf + off,
+				    UTF8_SIZE);
+			}
+		}
+	}
+
+	while (off > 0 && buf[off - 1] == ' ')
+		off--;
+	buf[off] = '\0';
+	return (buf);
+}
+
+/*
+ * Check if a packed line may contain a set of cells, comparing only the
+ * character data.
+ */
+int
+grid_packed_find(const struct grid_line *gl, const struct grid_cell *gc,
+    u_int n)
+{
+	struct grid_packed	 gp;
+	const u_char		*data, *p;
+	u_char			*find;
+	size_t			 packedsize, size;
+
+	/* Trailing spaces may match past the end of the line. */
+	while (n > 0 && !(gc[n - 1].flags & GRID_FLAG_UTF8) &&
+	    gc[n - 1].data == ' ')
+		n--;
+	if (n == 0)
+		return (1);
+
+	find = grid_compress_ensure(&grid_compress_buf2,
+	    &grid_compress_buf2size, n * 16);
+	size = grid_pack_cells(gc, n, find);
+
+	data = grid_packed_data(gl, &packedsize);
+	grid_packed_parse(&gp, data, packedsize);
+
+	for (p = gp.text; (size_t) (gp.end - p) >= size; p++) {
+		p = memchr(p, find[0], gp.end - p - size + 1);
+		if (p == NULL)
+			break;
+		if (memcmp(p, find, size) == 0)
+			return (1);
+	}
+	return (0);
+}
+
+/* Mark the UTF-8 table entries used by the cells of a packed line. */
+void
+grid_packed_mark(const struct grid_line *gl)
+{
+	struct grid_packed	 gp;
+	const u_char		*data, *runs, *text;
+	size_t			 packedsize;
+	u_int			 n, i;
+	int			 utf8;
+
+	data = grid_packed_data(gl, &packedsize);
+	grid_packed_parse(&gp, data, packedsize);
+
+	runs = gp.runs;
+	text = gp.text;
+	for (i = 0; i < gp.nruns; i++) {
+		n = grid_compress_get_number(&runs, gp.text);
+		utf8 = runs[1] & GRID_FLAG_UTF8;
+		runs += 4;
+		for (; n > 0; n--)
+			grid_utf8_mark(grid_unpack_cell(&text, gp.end, utf8));
+	}
+}
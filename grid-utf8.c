@@ -18,14 +18,75 @@
 
 #include <sys/types.h>
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "tmux.h"
 
 /*
  * Grid UTF-8 utility functions.
+ *
+ * UTF-8 cells store the character in the data member of the grid cell. A
+ * single Unicode character is stored directly as its code point. A combined
+ * character (a character followed by combining characters) is put into a
+ * table shared by all grids and the cell holds GRID_UTF8_TABLE plus the index
+ * of the table entry. The same sequence always has the same value, so cells
+ * may be compared directly.
+ *
+ * Table entries are not reference counted. Instead, when the table has
+ * grid_utf8_limit entries, grid_utf8_sweep marks the entries used by every
+ * grid and client frame and frees the others for reuse. The limit is then
+ * raised if most entries are still in use, so the table only grows with the
+ * number of different combined characters on screen and in the history.
  */
 
+/* Number of UTF-8 table entries before the first sweep. */
+#define GRID_UTF8_SWEEP 4096
+
+/* UTF-8 table entry. */
+struct grid_utf8_entry {
+	struct grid_utf8	gu;
+	u_int			idx;
+
+	RB_ENTRY(grid_utf8_entry) entry;
+};
+RB_HEAD(grid_utf8_tree, grid_utf8_entry);
+ARRAY_DECL(grid_utf8_list, struct grid_utf8_entry *);
+
+int	grid_utf8_cmp(struct grid_utf8_entry *, struct grid_utf8_entry *);
+RB_PROTOTYPE(grid_utf8_tree, grid_utf8_entry, entry, grid_utf8_cmp);
+RB_GENERATE(grid_utf8_tree, grid_utf8_entry, entry, grid_utf8_cmp);
+
+/* Entries by sequence and by index, with free indexes to be reused. */
+struct grid_utf8_tree	grid_utf8_tree = RB_INITIALIZER(&grid_utf8_tree);
+struct grid_utf8_list	grid_utf8_list = ARRAY_INITIALIZER;
+ARRAY_DECL(, u_int)	grid_utf8_free = ARRAY_INITIALIZER;
+u_int			grid_utf8_count;
+u_int			grid_utf8_limit = GRID_UTF8_SWEEP;
+
+/* Entries found in use while sweeping. */
+u_char			*grid_utf8_used;
+
+u_int	grid_utf8_pack_char(const u_char *, size_t);
+u_int	grid_utf8_pack(const struct grid_utf8 *);
+void	grid_utf8_sweep(void);
+
+/* Compare table entries. */
+int
+grid_utf8_cmp(struct grid_utf8_entry *gue1, struct grid_utf8_entry *gue2)
+{
+	size_t	size1, size2;
+
+	if (gue1->gu.width != gue2->gu.width)
+		return (gue1->gu.width < gue2->gu.width ? -1 : 1);
+
+	size1 = grid_utf8_size(&gue1->gu);
+	size2 = grid_utf8_size(&gue2->gu);
+	if (size1 != size2)
+		return (size1 < size2 ? -1 : 1);
+	return (memcmp(gue1->gu.data, gue2->gu.data, size1));
+}
+
 /* Calculate UTF-8 grid cell size. Data is terminated by 0xff. */
 size_t
 grid_utf8_size(const struct grid_utf8 *gu)
@@ -52,45 +113,240 @@ grid_utf8_copy(const struct grid_utf8 *gu, char *buf, size_t len)
 	return (size);
 }
 
-/* Set UTF-8 grid data from input UTF-8. */
+/*
+ * Work out the cell value for a single character, which is its code point, or
+ * return UINT_MAX if the data is not a single character.
+ */
+u_int
+grid_utf8_pack_char(const u_char *data, size_t size)
+{
+	u_int	value;
+
+	switch (size) {
+	case 1:
+		if (data[0] < 0x80)
+			return (data[0]);
+		break;
+	case 2:
+		if (data[0] < 0xc2 || data[0] > 0xdf)
+			break;
+		return (((data[0] & 0x1f) << 6) | (data[1] & 0x3f));
+	case 3:
+		if (data[0] < 0xe0 || data[0] > 0xef)
+			break;
+		value = ((data[0] & 0x0f) << 12) | ((data[1] & 0x3f) << 6) |
+		    (data[2] & 0x3f);
+		if (value < 0x800)
+			break;
+		return (value);
+	case 4:
+		if (data[0] < 0xf0 || data[0] > 0xf4)
+			break;
+		value = ((data[0] & 0x07) << 18) | ((data[1] & 0x3f) << 12) |
+		    ((data[2] & 0x3f) << 6) | (data[3] & 0x3f);
+		if (value < 0x10000 || value >= GRID_UTF8_TABLE)
+			break;
+		return (value);
+	}
+	return (UINT_MAX);
+}
+
+/*
+ * Work out the cell value for UTF-8 data: the code point if it is a single
+ * character, otherwise a table entry.
+ */
+u_int
+grid_utf8_pack(const struct grid_utf8 *gu)
+{
+	struct grid_utf8_entry	 find, *gue;
+	u_int			 value, idx;
+
+	value = grid_utf8_pack_char(gu->data, grid_utf8_size(gu));
+	if (value != UINT_MAX)
+		return (value);
+
+	memcpy(&find.gu, gu, sizeof find.gu);
+	if ((gue = RB_FIND(grid_utf8_tree, &grid_utf8_tree, &find)) != NULL)
+		return (GRID_UTF8_TABLE + gue->idx);
+
+	if (grid_utf8_count == grid_utf8_limit)
+		grid_utf8_sweep();
+
+	gue = xmalloc(sizeof *gue);
+	memcpy(&gue->gu, gu, sizeof gue->gu);
+	if (ARRAY_LENGTH(&grid_utf8_free) != 0) {
+		idx = ARRAY_LAST(&grid_utf8_free);
+		ARRAY_TRUNC(&grid_utf8_free, 1);
+		ARRAY_SET(&grid_utf8_list, idx, gue);
+	} else {
+		idx = ARRAY_LENGTH(&grid_utf8_list);
+		ARRAY_ADD(&grid_utf8_list, gue);
+	}
+	gue->idx = idx;
+	RB_INSERT(grid_utf8_tree, &grid_utf8_tree, gue);
+	grid_utf8_count++;
+	return (GRID_UTF8_TABLE + idx);
+}
+
+/* Mark the table entry for a cell value as in use, while sweeping. */
+void
+grid_utf8_mark(u_int value)
+{
+	if (value < GRID_UTF8_TABLE)
+		return;
+	value -= GRID_UTF8_TABLE;
+
+	/* Invalid cells in a client's shadow hold values past the end. */
+	if (value < ARRAY_LENGTH(&grid_utf8_list))
+		grid_utf8_used[value] = 1;
+}
+
+/* Mark the table entries used by a set of cells. */
+void
+grid_utf8_mark_cells(const struct grid_cell *gc, u_int n)
+{
+	for (; n > 0; n--, gc++) {
+		if (gc->flags & GRID_FLAG_UTF8)
+			grid_utf8_mark(gc->data);
+	}
+}
+
+/*
+ * Free the table entries which are no longer used by any grid or by the
+ * frames of any client.
+ */
+void
+grid_utf8_sweep(void)
+{
+	struct grid_utf8_entry	*gue;
+	struct grid		*gd;
+	struct client		*c;
+	u_int			 i, n;
+
+	n = ARRAY_LENGTH(&grid_utf8_list);
+	grid_utf8_used = xcalloc(n, 1);
+
+	TAILQ_FOREACH(gd, &all_grids, entry)
+		grid_mark_utf8(gd);
+	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
+		c = ARRAY_ITEM(&clients, i);
+		if (c == NULL || c->tty.frame == NULL)
+			continue;
+		n = c->tty.sx * c->tty.sy;
+		grid_utf8_mark_cells(c->tty.frame, n);
+		grid_utf8_mark_cells(c->tty.shadow, n);
+	}
+
+	for (i = 0; i < ARRAY_LENGTH(&grid_utf8_list); i++) {
+		gue = ARRAY_ITEM(&grid_utf8_list, i);
+		if (gue == NULL || grid_utf8_used[i])
+			continue;
+		RB_REMOVE(grid_utf8_tree, &grid_utf8_tree, gue);
+		free(gue);
+		ARRAY_SET(&grid_utf8_list, i, NULL);
+		ARRAY_ADD(&grid_utf8_free, i);
+		grid_utf8_count--;
+	}
+	free(grid_utf8_used);
+	grid_utf8_used = NULL;
+
+	/* If most entries are still in use, wait for more before sweeping. */
+	if (grid_utf8_count > grid_utf8_limit / 2)
+		grid_utf8_limit = grid_utf8_count * 2;
+	log_debug("UTF-8 table swept: %u entries in use, limit %u",
+	    grid_utf8_count, grid_utf8_limit);
+}
+
+/* Get the UTF-8 data for a cell. */
 void
-grid_utf8_set(struct grid_utf8 *gu, const struct utf8_data *utf8data)
+grid_utf8_get(const struct grid_cell *gc, struct grid_utf8 *gu)
 {
+	u_int	value = gc->data;
+
+	if (value >= GRID_UTF8_TABLE) {
+		value -= GRID_UTF8_TABLE;
+		if (value >= ARRAY_LENGTH(&grid_utf8_list) ||
+		    ARRAY_ITEM(&grid_utf8_list, value) == NULL)
+			fatalx("bad UTF-8 table index");
+		memcpy(gu, &ARRAY_ITEM(&grid_utf8_list, value)->gu, sizeof *gu);
+		return;
+	}
+
+	gu->width = grid_cell_width(gc);
+	if (value < 0x80) {
+		gu->data[0] = value;
+		gu->data[1] = 0xff;
+	} else if (value < 0x800) {
+		gu->data[0] = (value >> 6) | 0xc0;
+		gu->data[1] = (value & 0x3f) | 0x80;
+		gu->data[2] = 0xff;
+	} else if (value < 0x10000) {
+		gu->data[0] = (value >> 12) | 0xe0;
+		gu->data[1] = ((value >> 6) & 0x3f) | 0x80;
+		gu->data[2] = (value & 0x3f) | 0x80;
+		gu->data[3] = 0xff;
+	} else {
+		gu->data[0] = (value >> 18) | 0xf0;
+		gu->data[1] = ((value >> 12) & 0x3f) | 0x80;
+		gu->data[2] = ((value >> 6) & 0x3f) | 0x80;
+		gu->data[3] = (value & 0x3f) | 0x80;
+		gu->data[4] = 0xff;
+	}
+}
+
+/* Put UTF-8 grid data into a cell. */
+void
+grid_utf8_put(struct grid_cell *gc, const struct grid_utf8 *gu)
+{
+	gc->data = grid_utf8_pack(gu);
+	gc->flags |= GRID_FLAG_UTF8;
+	if (gu->width > 1)
+		gc->flags |= GRID_FLAG_WIDE;
+	else
+		gc->flags &= ~GRID_FLAG_WIDE;
+}
+
+/* Set cell from input UTF-8. */
+void
+grid_utf8_set(struct grid_cell *gc, const struct utf8_data *utf8data)
+{
+	struct grid_utf8	gu;
+
 	if (utf8data->size == 0)
 		fatalx("UTF-8 data empty");
-	if (utf8data->size > sizeof gu->data)
+	if (utf8data->size > sizeof gu.data)
 		fatalx("UTF-8 data too long");
-	memcpy(gu->data, utf8data->data, utf8data->size);
-	if (utf8data->size != sizeof gu->data)
-		gu->data[utf8data->size] = 0xff;
-	gu->width = utf8data->width;
+	memcpy(gu.data, utf8data->data, utf8data->size);
+	if (utf8data->size != sizeof gu.data)
+		gu.data[utf8data->size] = 0xff;
+	gu.width = utf8data->width;
+
+	grid_utf8_put(gc, &gu);
 }
 
 /* Append UTF-8 character onto the cell data (for combined characters). */
 int
-grid_utf8_append(struct grid_utf8 *gu, const struct utf8_data *utf8data)
+grid_utf8_append(struct grid_cell *gc, const struct utf8_data *utf8data)
 {
-	size_t	old_size;
+	struct grid_utf8	gu;
+	size_t			old_size;
+
+	grid_utf8_get(gc, &gu);
 
-	old_size = grid_utf8_size(gu);
-	if (old_size + utf8data->size > sizeof gu->data)
+	old_size = grid_utf8_size(&gu);
+	if (old_size + utf8data->size > sizeof gu.data)
 		return (-1);
-	memcpy(gu->data + old_size, utf8data->data, utf8data->size);
-	if (old_size + utf8data->size != sizeof gu->data)
-		gu->data[old_size + utf8data->size] = 0xff;
+	memcpy(gu.data + old_size, utf8data->data, utf8data->size);
+	if (old_size + utf8data->size != sizeof gu.data)
+		gu.data[old_size + utf8data->size] = 0xff;
+
+	grid_utf8_put(gc, &gu);
 	return (0);
 }
 
-/* Compare two UTF-8 cells. */
-int
-grid_utf8_compare(const struct grid_utf8 *gu1, const struct grid_utf8 *gu2)
+/* Return the number of entries in the UTF-8 table. */
+u_int
+grid_utf8_entries(void)
 {
-	size_t	size;
-
-	size = grid_utf8_size(gu1);
-	if (size != grid_utf8_size(gu2))
-		return (0);
-	if (memcmp(gu1->data, gu2->data, size) != 0)
-		return (0);
-	return (1);
+	return (grid_utf8_count);
 }
@@ -33,22 +33,42 @@
  * (hsize - 1); from hsize to hsize + (sy - 1) is the viewable data. All
  * functions in this file work on absolute coordinates, grid-view.c has
  * functions which work on the screen data.
+ *
+ * The lines are held in a circular buffer (linedata) with a power of two
+ * number of entries (linesize). Row 0 is at lineoff, so scrolling a line into
+ * the history or freeing lines from the top of the history just moves the
+ * offset rather than copying the array. The buffer is only reallocated when
+ * it needs to grow.
+ *
+ * Lines are packed into runs of attributes and a string of character data as
+ * they are scrolled into the history, and history lines more than hhot lines
+ * from the bottom of the history are cold and are compressed as well (see
+ * grid-compress.c). Any access to the cells of a packed line through
+ * grid_get_line unpacks it again. Unpacked history lines are packed again by
+ * grid_compress_history, which is called when enough have built up or when the
+ * caller has finished with them.
  */
 
 /* Default grid cell data. */
 const struct grid_cell grid_default_cell = { 0, 0, 8, 8, ' ' };
 const struct grid_cell grid_marker_cell = { 0, 0, 8, 8, '_' };
 
+/* All grids, for finding the UTF-8 table entries in use. */
+struct grids all_grids = TAILQ_HEAD_INITIALIZER(all_grids);
+
+#define grid_line(gd, py) \
+	(&(gd)->linedata[((gd)->lineoff + (py)) & ((gd)->linesize - 1)])
+
 #define grid_put_cell(gd, px, py, gc) do {			\
-	memcpy(&gd->linedata[py].celldata[px], 			\
-	    gc, sizeof gd->linedata[py].celldata[px]);		\
-} while (0)
-#define grid_put_utf8(gd, px, py, gc) do {			\
-	memcpy(&gd->linedata[py].utf8data[px], 			\
-	    gc, sizeof gd->linedata[py].utf8data[px]);		\
+	memcpy(&grid_line(gd, py)->celldata[px], 		\
+	    gc, sizeof grid_line(gd, py)->celldata[px]);	\
 } while (0)
 
+/* Number of history lines unpacked before they are packed again. */
+#define GRID_THAWED_LIMIT 128
+
 int	grid_check_y(struct grid *, u_int);
+void	grid_cool_history(struct grid *);
 
 #ifdef DEBUG
 int
@@ -85,8 +105,17 @@ grid_create(u_int sx, u_int sy, u_int hlimit)
 	gd->hsize = 0;
 	gd->hlimit = hlimit;
 
-	gd->linedata = xcalloc(gd->sy, sizeof *gd->linedata);
+	gd->hhot = UINT_MAX;
+	gd->hthawed = 0;
+	gd->hcompressed = 0;
+	gd->huncompressed = 0;
 
+	gd->linedata = NULL;
+	gd->linesize = 0;
+	gd->lineoff = 0;
+	grid_expand_lines(gd, gd->sy);
+
+	TAILQ_INSERT_TAIL(&all_grids, gd, entry);
 	return (gd);
 }
 
@@ -97,10 +126,12 @@ grid_destroy(struct grid *gd)
 	struct grid_line	*gl;
 	u_int			 yy;
 
+	TAILQ_REMOVE(&all_grids, gd, entry);
+
 	for (yy = 0; yy < gd->hsize + gd->sy; yy++) {
-		gl = &gd->linedata[yy];
+		gl = grid_line(gd, yy);
+		grid_free_packed(gd, gl);
 		free(gl->celldata);
-		free(gl->utf8data);
 	}
 
 	free(gd->linedata);
@@ -114,15 +145,14 @@ grid_compare(struct grid *ga, struct grid *gb)
 {
 	struct grid_line	*gla, *glb;
 	struct grid_cell	*gca, *gcb;
-	struct grid_utf8	*gua, *gub;
 	u_int			 xx, yy;
 
 	if (ga->sx != gb->sx || ga->sy != ga->sy)
 		return (1);
 
 	for (yy = 0; yy < ga->sy; yy++) {
-		gla = &ga->linedata[yy];
-		glb = &gb->linedata[yy];
+		gla = grid_get_line(ga, yy);
+		glb = grid_get_line(gb, yy);
 		if (gla->cellsize != glb->cellsize)
 			return (1);
 		for (xx = 0; xx < ga->sx; xx++) {
@@ -130,21 +160,74 @@ grid_compare(struct grid *ga, struct grid *gb)
 			gcb = &glb->celldata[xx];
 			if (memcmp(gca, gcb, sizeof (struct grid_cell)) != 0)
 				return (1);
-			if (!(gca->flags & GRID_FLAG_UTF8))
-				continue;
-			gua = &gla->utf8data[xx];
-			gub = &glb->utf8data[xx];
-			if (memcmp(gua, gub, sizeof (struct grid_utf8)) != 0)
-				return (1);
 		}
 	}
 
 	return (0);
 }
 
+/* Get line for reading or writing, unpacking it if necessary. */
+struct grid_line *
+grid_get_line(struct grid *gd, u_int py)
+{
+	struct grid_line	*gl;
+
+	gl = grid_line(gd, py);
+	if (gl->flags & GRID_LINE_PACKED) {
+		grid_unpack_line(gd, gl);
+		gd->hthawed++;
+	}
+	return (gl);
+}
+
+/*
+ * Get line for looking at the size and flags only. The cells may not be
+ * available.
+ */
+const struct grid_line *
+grid_peek_line(struct grid *gd, u_int py)
+{
+	return (grid_line(gd, py));
+}
+
+/*
+ * Make sure the line buffer has space for at least ny lines. The buffer is
+ * grown to the next power of two and unwrapped so row 0 is at the start again.
+ * Newly added entries are zeroed.
+ */
+void
+grid_expand_lines(struct grid *gd, u_int ny)
+{
+	struct grid_line	*linedata;
+	u_int			 linesize, first;
+
+	if (ny <= gd->linesize)
+		return;
+
+	linesize = gd->linesize;
+	if (linesize == 0)
+		linesize = 1;
+	while (linesize < ny)
+		linesize *= 2;
+	linedata = xcalloc(linesize, sizeof *linedata);
+
+	if (gd->linesize != 0) {
+		first = gd->linesize - gd->lineoff;
+		memcpy(linedata, &gd->linedata[gd->lineoff],
+		    first * sizeof *linedata);
+		memcpy(&linedata[first], gd->linedata,
+		    gd->lineoff * sizeof *linedata);
+	}
+	free(gd->linedata);
+
+	gd->linedata = linedata;
+	gd->linesize = linesize;
+	gd->lineoff = 0;
+}
+
 /*
  * Collect lines from the history if at the limit. Free the top (oldest) 10%
- * and shift up.
+ * and move the start of the buffer past them.
  */
 void
 grid_collect_history(struct grid *gd)
@@ -160,10 +243,46 @@ grid_collect_history(struct grid *gd)
 	if (yy < 1)
 		yy = 1;
 
-	grid_move_lines(gd, 0, yy, gd->hsize + gd->sy - yy);
+	grid_clear_lines(gd, 0, yy);
+	gd->lineoff = (gd->lineoff + yy) & (gd->linesize - 1);
 	gd->hsize -= yy;
 }
 
+/* Pack any unpacked history lines and compress any unpacked cold lines. */
+void
+grid_compress_history(struct grid *gd)
+{
+	u_int	yy, cold;
+
+	cold = 0;
+	if (gd->hsize > gd->hhot)
+		cold = gd->hsize - gd->hhot;
+	for (yy = 0; yy < gd->hsize; yy++) {
+		if (yy < cold)
+			grid_compress_line(gd, grid_line(gd, yy));
+		else
+			grid_pack_line(grid_line(gd, yy));
+	}
+	gd->hthawed = 0;
+}
+
+/*
+ * Pack the line which has just been added to the history and compress the line
+ * which has become cold, or pack and compress the whole history if too many
+ * lines have been unpacked.
+ */
+void
+grid_cool_history(struct grid *gd)
+{
+	if (gd->hthawed > GRID_THAWED_LIMIT) {
+		grid_compress_history(gd);
+		return;
+	}
+	grid_pack_line(grid_line(gd, gd->hsize - 1));
+	if (gd->hsize > gd->hhot)
+		grid_compress_line(gd, grid_line(gd, gd->hsize - gd->hhot - 1));
+}
+
 /*
  * Scroll the entire visible screen, moving one line into the history. Just
  * allocate a new line at the bottom and move the history size indicator.
@@ -176,44 +295,51 @@ grid_scroll_history(struct grid *gd)
 	GRID_DEBUG(gd, "");
 
 	yy = gd->hsize + gd->sy;
-	gd->linedata = xrealloc(gd->linedata, yy + 1, sizeof *gd->linedata);
-	memset(&gd->linedata[yy], 0, sizeof gd->linedata[yy]);
+	grid_expand_lines(gd, yy + 1);
+	memset(grid_line(gd, yy), 0, sizeof *gd->linedata);
 
 	gd->hsize++;
+	grid_cool_history(gd);
 }
 
-/* Scroll a region up, moving the top line into the history. */
+/*
+ * Scroll a region up, moving the top line into the history. Rather than moving
+ * the region itself, the region's top line is moved to the end of the history
+ * and the lines above and below the region are each moved down by one, so the
+ * cost depends only on the number of lines outside the region.
+ */
 void
 grid_scroll_history_region(struct grid *gd, u_int upper, u_int lower)
 {
-	struct grid_line	*gl_history, *gl_upper, *gl_lower;
+	struct grid_line	 gl_history;
 	u_int			 yy;
 
 	GRID_DEBUG(gd, "upper=%u, lower=%u", upper, lower);
 
 	/* Create a space for a new line. */
 	yy = gd->hsize + gd->sy;
-	gd->linedata = xrealloc(gd->linedata, yy + 1, sizeof *gd->linedata);
+	grid_expand_lines(gd, yy + 1);
 
-	/* Move the entire screen down to free a space for this line. */
-	gl_history = &gd->linedata[gd->hsize];
-	memmove(gl_history + 1, gl_history, gd->sy * sizeof *gl_history);
-
-	/* Adjust the region and find its start and end. */
-	upper++;
-	gl_upper = &gd->linedata[upper];
-	lower++;
-	gl_lower = &gd->linedata[lower];
+	/* Move the lines above the region down over the top line. */
+	memcpy(&gl_history, grid_line(gd, upper), sizeof gl_history);
+	for (; upper > gd->hsize; upper--) {
+		memcpy(grid_line(gd, upper),
+		    grid_line(gd, upper - 1), sizeof gl_history);
+	}
 
 	/* Move the line into the history. */
-	memcpy(gl_history, gl_upper, sizeof *gl_history);
+	memcpy(grid_line(gd, gd->hsize), &gl_history, sizeof gl_history);
 
-	/* Then move the region up and clear the bottom line. */
-	memmove(gl_upper, gl_upper + 1, (lower - upper) * sizeof *gl_upper);
-	memset(gl_lower, 0, sizeof *gl_lower);
+	/* Move the lines below the region down and clear the bottom line. */
+	for (; yy > lower + 1; yy--) {
+		memcpy(grid_line(gd, yy),
+		    grid_line(gd, yy - 1), sizeof gl_history);
+	}
+	memset(grid_line(gd, lower + 1), 0, sizeof gl_history);
 
 	/* Move the history offset down over the line. */
 	gd->hsize++;
+	grid_cool_history(gd);
 }
 
 /* Expand line to fit to cell. */
@@ -223,7 +349,7 @@ grid_expand_line(struct grid *gd, u_int py, u_int sx)
 	struct grid_line	*gl;
 	u_int			 xx;
 
-	gl = &gd->linedata[py];
+	gl = grid_get_line(gd, py);
 	if (sx <= gl->cellsize)
 		return;
 
@@ -233,30 +359,19 @@ grid_expand_line(struct grid *gd, u_int py, u_int sx)
 	gl->cellsize = sx;
 }
 
-/* Expand line to fit to cell for UTF-8. */
-void
-grid_expand_line_utf8(struct grid *gd, u_int py, u_int sx)
-{
-	struct grid_line	*gl;
-
-	gl = &gd->linedata[py];
-	if (sx <= gl->utf8size)
-		return;
-
-	gl->utf8data = xrealloc(gl->utf8data, sx, sizeof *gl->utf8data);
-	gl->utf8size = sx;
-}
-
 /* Get cell for reading. */
 const struct grid_cell *
 grid_peek_cell(struct grid *gd, u_int px, u_int py)
 {
+	struct grid_line	*gl;
+
 	if (grid_check_y(gd, py) != 0)
 		return (&grid_default_cell);
 
-	if (px >= gd->linedata[py].cellsize)
+	gl = grid_get_line(gd, py);
+	if (px >= gl->cellsize)
 		return (&grid_default_cell);
-	return (&gd->linedata[py].celldata[px]);
+	return (&gl->celldata[px]);
 }
 
 /* Get cell at relative position (for writing). */
@@ -267,7 +382,7 @@ grid_get_cell(struct grid *gd, u_int px, u_int py)
 		return (NULL);
 
 	grid_expand_line(gd, py, px + 1);
-	return (&gd->linedata[py].celldata[px]);
+	return (&grid_line(gd, py)->celldata[px]);
 }
 
 /* Set cell at relative position. */
@@ -282,46 +397,31 @@ grid_set_cell(
 	grid_put_cell(gd, px, py, gc);
 }
 
-/* Get UTF-8 for reading. */
-const struct grid_utf8 *
-grid_peek_utf8(struct grid *gd, u_int px, u_int py)
-{
-	if (grid_check_y(gd, py) != 0)
-		return (NULL);
-
-	if (px >= gd->linedata[py].utf8size)
-		return (NULL);
-	return (&gd->linedata[py].utf8data[px]);
-}
-
-/* Get utf8 at relative position (for writing). */
-struct grid_utf8 *
-grid_get_utf8(struct grid *gd, u_int px, u_int py)
-{
-	if (grid_check_y(gd, py) != 0)
-		return (NULL);
-
-	grid_expand_line_utf8(gd, py, px + 1);
-	return (&gd->linedata[py].utf8data[px]);
-}
-
-/* Set utf8 at relative position. */
+/* Set a run of cells with the same attributes at relative position. */
 void
-grid_set_utf8(
-    struct grid *gd, u_int px, u_int py, const struct grid_utf8 *gc)
+grid_set_cells(struct grid *gd, u_int px, u_int py,
+    const struct grid_cell *gc, const u_char *s, u_int n)
 {
+	struct grid_cell	*gce;
+	u_int			 xx;
+
 	if (grid_check_y(gd, py) != 0)
 		return;
 
-	grid_expand_line_utf8(gd, py, px + 1);
-	grid_put_utf8(gd, px, py, gc);
+	grid_expand_line(gd, py, px + n);
+	gce = &grid_line(gd, py)->celldata[px];
+	for (xx = 0; xx < n; xx++) {
+		memcpy(&gce[xx], gc, sizeof gce[xx]);
+		gce[xx].data = s[xx];
+	}
 }
 
 /* Clear area. */
 void
 grid_clear(struct grid *gd, u_int px, u_int py, u_int nx, u_int ny)
 {
-	u_int	xx, yy;
+	struct grid_line	*gl;
+	u_int			 xx, yy;
 
 	GRID_DEBUG(gd, "px=%u, py=%u, nx=%u, ny=%u", px, py, nx, ny);
 
@@ -339,14 +439,15 @@ grid_clear(struct grid *gd, u_int px, u_int py, u_int nx, u_int ny)
 		return;
 
 	for (yy = py; yy < py + ny; yy++) {
-		if (px >= gd->linedata[yy].cellsize)
+		gl = grid_get_line(gd, yy);
+		if (px >= gl->cellsize)
 			continue;
-		if (px + nx >= gd->linedata[yy].cellsize) {
-			gd->linedata[yy].cellsize = px;
+		if (px + nx >= gl->cellsize) {
+			gl->cellsize = px;
 			continue;
 		}
 		for (xx = px; xx < px + nx; xx++) {
-			if (xx >= gd->linedata[yy].cellsize)
+			if (xx >= gl->cellsize)
 				break;
 			grid_put_cell(gd, xx, yy, &grid_default_cell);
 		}
@@ -371,13 +472,25 @@ grid_clear_lines(struct grid *gd, u_int py, u_int ny)
 		return;
 
 	for (yy = py; yy < py + ny; yy++) {
-		gl = &gd->linedata[yy];
+		gl = grid_line(gd, yy);
+		grid_free_packed(gd, gl);
 		free(gl->celldata);
-		free(gl->utf8data);
 		memset(gl, 0, sizeof *gl);
 	}
 }
 
+/* Remove all history lines. */
+void
+grid_clear_history(struct grid *gd)
+{
+	GRID_DEBUG(gd, "");
+
+	grid_clear_lines(gd, 0, gd->hsize);
+	gd->lineoff = (gd->lineoff + gd->hsize) & (gd->linesize - 1);
+	gd->hsize = 0;
+	gd->hthawed = 0;
+}
+
 /* Move a group of lines. */
 void
 grid_move_lines(struct grid *gd, u_int dy, u_int py, u_int ny)
@@ -405,14 +518,27 @@ grid_move_lines(struct grid *gd, u_int dy, u_int py, u_int ny)
 		grid_clear_lines(gd, yy, 1);
 	}
 
-	memmove(
-	    &gd->linedata[dy], &gd->linedata[py], ny * (sizeof *gd->linedata));
+	/*
+	 * The lines may wrap around the end of the buffer, so move them one
+	 * at a time, in the right direction for overlapping ranges.
+	 */
+	if (dy < py) {
+		for (yy = 0; yy < ny; yy++) {
+			memcpy(grid_line(gd, dy + yy),
+			    grid_line(gd, py + yy), sizeof *gd->linedata);
+		}
+	} else {
+		for (yy = ny; yy > 0; yy--) {
+			memcpy(grid_line(gd, dy + yy - 1),
+			    grid_line(gd, py + yy - 1), sizeof *gd->linedata);
+		}
+	}
 
 	/* Wipe any lines that have been moved (without freeing them). */
 	for (yy = py; yy < py + ny; yy++) {
 		if (yy >= dy && yy < dy + ny)
 			continue;
-		memset(&gd->linedata[yy], 0, sizeof gd->linedata[yy]);
+		memset(grid_line(gd, yy), 0, sizeof *gd->linedata);
 	}
 }
 
@@ -430,20 +556,13 @@ grid_move_cells(struct grid *gd, u_int dx, u_int px, u_int py, u_int nx)
 
 	if (grid_check_y(gd, py) != 0)
 		return;
-	gl = &gd->linedata[py];
+	gl = grid_get_line(gd, py);
 
 	grid_expand_line(gd, py, px + nx);
 	grid_expand_line(gd, py, dx + nx);
 	memmove(
 	    &gl->celldata[dx], &gl->celldata[px], nx * sizeof *gl->celldata);
 
-	if (gl->utf8data != NULL) {
-		grid_expand_line_utf8(gd, py, px + nx);
-		grid_expand_line_utf8(gd, py, dx + nx);
-		memmove(&gl->utf8data[dx],
-		    &gl->utf8data[px], nx * sizeof *gl->utf8data);
-	}
-
 	/* Wipe any cells that have been moved. */
 	for (xx = px; xx < px + nx; xx++) {
 		if (xx >= dx && xx < dx + nx)
@@ -456,14 +575,22 @@ grid_move_cells(struct grid *gd, u_int dx, u_int px, u_int py, u_int nx)
 char *
 grid_string_cells(struct grid *gd, u_int px, u_int py, u_int nx)
 {
+	struct grid_line	*gl;
 	const struct grid_cell	*gc;
-	const struct grid_utf8	*gu;
+	struct grid_utf8	 gu;
 	char			*buf;
 	size_t			 len, off, size;
 	u_int			 xx;
 
 	GRID_DEBUG(gd, "px=%u, py=%u, nx=%u", px, py, nx);
 
+	/* Packed lines can be converted without unpacking them. */
+	if (py < gd->hsize + gd->sy) {
+		gl = grid_line(gd, py);
+		if (gl->flags & GRID_LINE_PACKED)
+			return (grid_packed_string(gl, px, nx));
+	}
+
 	len = 128;
 	buf = xmalloc(len);
 	off = 0;
@@ -474,15 +601,15 @@ grid_string_cells(struct grid *gd, u_int px, u_int py, u_int nx)
 			continue;
 
 		if (gc->flags & GRID_FLAG_UTF8) {
-			gu = grid_peek_utf8(gd, xx, py);
+			grid_utf8_get(gc, &gu);
 
-			size = grid_utf8_size(gu);
+			size = grid_utf8_size(&gu);
 			while (len < off + size + 1) {
 				buf = xrealloc(buf, 2, len);
 				len *= 2;
 			}
 
-			off += grid_utf8_copy(gu, buf + off, len - off);
+			off += grid_utf8_copy(&gu, buf + off, len - off);
 		} else {
 			while (len < off + 2) {
 				buf = xrealloc(buf, 2, len);
@@ -499,6 +626,26 @@ grid_string_cells(struct grid *gd, u_int px, u_int py, u_int nx)
 	return (buf);
 }
 
+/*
+ * Check if a line may contain the characters in the first line of another
+ * grid. Only packed lines are checked (without unpacking them); for any other
+ * line this always returns 1.
+ */
+int
+grid_may_contain(struct grid *gd, u_int py, struct grid *sgd)
+{
+	struct grid_line	*gl, *sgl;
+
+	if (grid_check_y(gd, py) != 0)
+		return (0);
+	gl = grid_line(gd, py);
+	if (!(gl->flags & GRID_LINE_PACKED))
+		return (1);
+
+	sgl = grid_get_line(sgd, 0);
+	return (grid_packed_find(gl, sgl->celldata, sgl->cellsize));
+}
+
 /*
  * Duplicate a set of lines between two grids. If there aren't enough lines in
  * either source or destination, the number of lines is limited to the number
@@ -520,8 +667,8 @@ grid_duplicate_lines(
 	grid_clear_lines(dst, dy, ny);
 
 	for (yy = 0; yy < ny; yy++) {
-		srcl = &src->linedata[sy];
-		dstl = &dst->linedata[dy];
+		srcl = grid_get_line(src, sy);
+		dstl = grid_line(dst, dy);
 
 		memcpy(dstl, srcl, sizeof *dstl);
 		if (srcl->cellsize != 0) {
@@ -530,14 +677,24 @@ grid_duplicate_lines(
 			memcpy(dstl->celldata, srcl->celldata,
 			    srcl->cellsize * sizeof *dstl->celldata);
 		}
-		if (srcl->utf8size != 0) {
-			dstl->utf8data = xcalloc(
-			    srcl->utf8size, sizeof *dstl->utf8data);
-			memcpy(dstl->utf8data, srcl->utf8data,
-			    srcl->utf8size * sizeof *dstl->utf8data);
-		}
 
 		sy++;
 		dy++;
 	}
 }
+
+/* Mark the UTF-8 table entries used by the cells of a grid. */
+void
+grid_mark_utf8(struct grid *gd)
+{
+	struct grid_line	*gl;
+	u_int			 yy;
+
+	for (yy = 0; yy < gd->hsize + gd->sy; yy++) {
+		gl = grid_line(gd, yy);
+		if (gl->flags & GRID_LINE_PACKED)
+			grid_packed_mark(gl);
+		else
+			grid_utf8_mark_cells(gl->celldata, gl->cellsize);
+	}
+}
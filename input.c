@@ -76,8 +76,11 @@ int	input_utf8_open(struct input_ctx *);
 int	input_utf8_add(struct input_ctx *);
 int	input_utf8_close(struct input_ctx *);
 
-/* Command table comparison function. */
-int	input_table_compare(const void *, const void *);
+/* Lookup table functions. */
+struct input_table_entry;
+void	input_build(void);
+const struct input_table_entry *input_table_find(struct input_ctx *,
+	    const struct input_table_entry *, size_t, const u_char *);
 
 /* Command table entry. */
 struct input_table_entry {
@@ -185,6 +188,14 @@ const struct input_table_entry input_csi_table[] = {
 	{ 'u', "",  INPUT_CSI_RCP },
 };
 
+/*
+ * For each final character, the index plus one of its first entry in the
+ * escape and control command tables, or zero if there is none. Built by
+ * input_build.
+ */
+u_char	input_esc_index[256];
+u_char	input_csi_index[256];
+
 /* Input transition. */
 struct input_transition {
 	int				first;
@@ -200,6 +211,9 @@ struct input_state {
 	void				(*enter)(struct input_ctx *);
 	void				(*exit)(struct input_ctx *);
 	const struct input_transition	*transitions;
+
+	/* Transition for each byte, built from the table by input_build. */
+	const struct input_transition	**lookup;
 };
 
 /* State transitions available from all states. */
@@ -230,144 +244,210 @@ const struct input_transition input_state_utf8_three_table[];
 const struct input_transition input_state_utf8_two_table[];
 const struct input_transition input_state_utf8_one_table[];
 
+/* Direct lookup tables for each state. */
+const struct input_transition *input_state_ground_lookup[256];
+const struct input_transition *input_state_esc_enter_lookup[256];
+const struct input_transition *input_state_esc_intermediate_lookup[256];
+const struct input_transition *input_state_csi_enter_lookup[256];
+const struct input_transition *input_state_csi_parameter_lookup[256];
+const struct input_transition *input_state_csi_intermediate_lookup[256];
+const struct input_transition *input_state_csi_ignore_lookup[256];
+const struct input_transition *input_state_dcs_enter_lookup[256];
+const struct input_transition *input_state_dcs_parameter_lookup[256];
+const struct input_transition *input_state_dcs_intermediate_lookup[256];
+const struct input_transition *input_state_dcs_handler_lookup[256];
+const struct input_transition *input_state_dcs_escape_lookup[256];
+const struct input_transition *input_state_dcs_ignore_lookup[256];
+const struct input_transition *input_state_osc_string_lookup[256];
+const struct input_transition *input_state_apc_string_lookup[256];
+const struct input_transition *input_state_rename_string_lookup[256];
+const struct input_transition *input_state_consume_st_lookup[256];
+const struct input_transition *input_state_utf8_three_lookup[256];
+const struct input_transition *input_state_utf8_two_lookup[256];
+const struct input_transition *input_state_utf8_one_lookup[256];
+
 /* ground state definition. */
 const struct input_state input_state_ground = {
 	"ground",
 	NULL, NULL,
-	input_state_ground_table
+	input_state_ground_table,
+	input_state_ground_lookup
 };
 
 /* esc_enter state definition. */
 const struct input_state input_state_esc_enter = {
 	"esc_enter",
 	input_clear, NULL,
-	input_state_esc_enter_table
+	input_state_esc_enter_table,
+	input_state_esc_enter_lookup
 };
 
 /* esc_intermediate state definition. */
 const struct input_state input_state_esc_intermediate = {
 	"esc_intermediate",
 	NULL, NULL,
-	input_state_esc_intermediate_table
+	input_state_esc_intermediate_table,
+	input_state_esc_intermediate_lookup
 };
 
 /* csi_enter state definition. */
 const struct input_state input_state_csi_enter = {
 	"csi_enter",
 	input_clear, NULL,
-	input_state_csi_enter_table
+	input_state_csi_enter_table,
+	input_state_csi_enter_lookup
 };
 
 /* csi_parameter state definition. */
 const struct input_state input_state_csi_parameter = {
 	"csi_parameter",
 	NULL, NULL,
-	input_state_csi_parameter_table
+	input_state_csi_parameter_table,
+	input_state_csi_parameter_lookup
 };
 
 /* csi_intermediate state definition. */
 const struct input_state input_state_csi_intermediate = {
 	"csi_intermediate",
 	NULL, NULL,
-	input_state_csi_intermediate_table
+	input_state_csi_intermediate_table,
+	input_state_csi_intermediate_lookup
 };
 
 /* csi_ignore state definition. */
 const struct input_state input_state_csi_ignore = {
 	"csi_ignore",
 	NULL, NULL,
-	input_state_csi_ignore_table
+	input_state_csi_ignore_table,
+	input_state_csi_ignore_lookup
 };
 
 /* dcs_enter state definition. */
 const struct input_state input_state_dcs_enter = {
 	"dcs_enter",
 	input_clear, NULL,
-	input_state_dcs_enter_table
+	input_state_dcs_enter_table,
+	input_state_dcs_enter_lookup
 };
 
 /* dcs_parameter state definition. */
 const struct input_state input_state_dcs_parameter = {
 	"dcs_parameter",
 	NULL, NULL,
-	input_state_dcs_parameter_table
+	input_state_dcs_parameter_table,
+	input_state_dcs_parameter_lookup
 };
 
 /* dcs_intermediate state definition. */
 const struct input_state input_state_dcs_intermediate = {
 	"dcs_intermediate",
 	NULL, NULL,
-	input_state_dcs_intermediate_table
+	input_state_dcs_intermediate_table,
+	input_state_dcs_intermediate_lookup
 };
 
 /* dcs_handler state definition. */
 const struct input_state input_state_dcs_handler = {
 	"dcs_handler",
 	NULL, NULL,
-	input_state_dcs_handler_table
+	input_state_dcs_handler_table,
+	input_state_dcs_handler_lookup
 };
 
 /* dcs_escape state definition. */
 const struct input_state input_state_dcs_escape = {
 	"dcs_escape",
 	NULL, NULL,
-	input_state_dcs_escape_table
+	input_state_dcs_escape_table,
+	input_state_dcs_escape_lookup
 };
 
 /* dcs_ignore state definition. */
 const struct input_state input_state_dcs_ignore = {
 	"dcs_ignore",
 	NULL, NULL,
-	input_state_dcs_ignore_table
+	input_state_dcs_ignore_table,
+	input_state_dcs_ignore_lookup
 };
 
 /* osc_string state definition. */
 const struct input_state input_state_osc_string = {
 	"osc_string",
 	input_enter_osc, input_exit_osc,
-	input_state_osc_string_table
+	input_state_osc_string_table,
+	input_state_osc_string_lookup
 };
 
 /* apc_string state definition. */
 const struct input_state input_state_apc_string = {
 	"apc_string",
 	input_enter_apc, input_exit_apc,
-	input_state_apc_string_table
+	input_state_apc_string_table,
+	input_state_apc_string_lookup
 };
 
 /* rename_string state definition. */
 const struct input_state input_state_rename_string = {
 	"rename_string",
 	input_enter_rename, input_exit_rename,
-	input_state_rename_string_table
+	input_state_rename_string_table,
+	input_state_rename_string_lookup
 };
 
 /* consume_st state definition. */
 const struct input_state input_state_consume_st = {
 	"consume_st",
 	NULL, NULL,
-	input_state_consume_st_table
+	input_state_consume_st_table,
+	input_state_consume_st_lookup
 };
 
 /* utf8_three state definition. */
 const struct input_state input_state_utf8_three = {
 	"utf8_three",
 	NULL, NULL,
-	input_state_utf8_three_table
+	input_state_utf8_three_table,
+	input_state_utf8_three_lookup
 };
 
 /* utf8_two state definition. */
 const struct input_state input_state_utf8_two = {
 	"utf8_two",
 	NULL, NULL,
-	input_state_utf8_two_table
+	input_state_utf8_two_table,
+	input_state_utf8_two_lookup
 };
 
 /* utf8_one state definition. */
 const struct input_state input_state_utf8_one = {
 	"utf8_one",
 	NULL, NULL,
-	input_state_utf8_one_table
+	input_state_utf8_one_table,
+	input_state_utf8_one_lookup
+};
+
+/* All states, for building the lookup tables. */
+const struct input_state *input_states[] = {
+	&input_state_ground,
+	&input_state_esc_enter,
+	&input_state_esc_intermediate,
+	&input_state_csi_enter,
+	&input_state_csi_parameter,
+	&input_state_csi_intermediate,
+	&input_state_csi_ignore,
+	&input_state_dcs_enter,
+	&input_state_dcs_parameter,
+	&input_state_dcs_intermediate,
+	&input_state_dcs_handler,
+	&input_state_dcs_escape,
+	&input_state_dcs_ignore,
+	&input_state_osc_string,
+	&input_state_apc_string,
+	&input_state_rename_string,
+	&input_state_consume_st,
+	&input_state_utf8_three,
+	&input_state_utf8_two,
+	&input_state_utf8_one,
 };
 
 /* ground state table. */
@@ -662,16 +742,59 @@ const struct input_transition input_state_utf8_one_table[] = {
 	{ -1, -1, NULL, NULL }
 };
 
-/* Input table compare. */
-int
-input_table_compare(const void *key, const void *value)
+/* Build the lookup tables from the transition and command tables. */
+void
+input_build(void)
 {
-	const struct input_ctx		*ictx = key;
-	const struct input_table_entry	*entry = value;
+	static int			 built;
+	const struct input_state	*state;
+	const struct input_transition	*itr;
+	u_int				 i, ch;
+
+	if (built)
+		return;
+	built = 1;
+
+	for (i = 0; i < nitems(input_states); i++) {
+		state = input_states[i];
+		for (ch = 0; ch < 256; ch++) {
+			itr = state->transitions;
+			while (itr->first != -1 && itr->last != -1) {
+				if ((int) ch >= itr->first &&
+				    (int) ch <= itr->last)
+					break;
+				itr++;
+			}
+			if (itr->first == -1 || itr->last == -1)
+				state->lookup[ch] = NULL;
+			else
+				state->lookup[ch] = itr;
+		}
+	}
 
-	if (ictx->ch != entry->ch)
-		return (ictx->ch - entry->ch);
-	return (strcmp(ictx->interm_buf, entry->interm));
+	for (i = nitems(input_esc_table); i > 0; i--)
+		input_esc_index[input_esc_table[i - 1].ch] = i;
+	for (i = nitems(input_csi_table); i > 0; i--)
+		input_csi_index[input_csi_table[i - 1].ch] = i;
+}
+
+/* Find the command table entry for the current character and intermediate. */
+const struct input_table_entry *
+input_table_find(struct input_ctx *ictx,
+    const struct input_table_entry *table, size_t n, const u_char *index)
+{
+	const struct input_table_entry	*entry;
+	u_int				 i;
+
+	if ((i = index[ictx->ch]) == 0)
+		return (NULL);
+	for (entry = &table[i - 1]; entry < table + n; entry++) {
+		if (entry->ch != ictx->ch)
+			break;
+		if (strcmp(ictx->interm_buf, entry->interm) == 0)
+			return (entry);
+	}
+	return (NULL);
 }
 
 /* Initialise input parser. */
@@ -680,6 +803,8 @@ input_init(struct window_pane *wp)
 {
 	struct input_ctx	*ictx = &wp->ictx;
 
+	input_build();
+
 	memcpy(&ictx->cell, &grid_default_cell, sizeof ictx->cell);
 
 	memcpy(&ictx->old_cell, &grid_default_cell, sizeof ictx->old_cell);
@@ -732,13 +857,12 @@ input_parse(struct window_pane *wp)
 	const struct input_transition	*itr;
 	struct evbuffer			*evb = wp->event->input;
 	u_char				*buf;
-	size_t				 len, off;
+	size_t				 len, off, n;
 
 	if (EVBUFFER_LENGTH(evb) == 0)
 		return;
 
-	wp->window->flags |= WINDOW_ACTIVITY;
-	wp->window->flags &= ~WINDOW_SILENCE;
+	server_window_alert(wp->window, WINDOW_ACTIVITY);
 
 	/*
 	 * Open the screen. Use NULL wp if there is a mode set as don't want to
@@ -756,17 +880,31 @@ input_parse(struct window_pane *wp)
 
 	/* Parse the input. */
 	while (off < len) {
+		/*
+		 * Printable ASCII in the ground state is by far the most
+		 * common input, so hand whole runs of it to the screen at once
+		 * rather than going through the state machine for each byte.
+		 */
+		if (ictx->state == &input_state_ground &&
+		    buf[off] >= 0x20 && buf[off] <= 0x7e) {
+			n = 1;
+			while (off + n < len && buf[off + n] >= 0x20 &&
+			    buf[off + n] <= 0x7e)
+				n++;
+			log_debug("%s: %zu printable", __func__, n);
+
+			screen_write_cells(&ictx->ctx, &ictx->cell, buf + off,
+			    n);
+			off += n;
+			continue;
+		}
+
 		ictx->ch = buf[off++];
 		log_debug("%s: '%c' %s", __func__, ictx->ch, ictx->state->name);
 
 		/* Find the transition. */
-		itr = ictx->state->transitions;
-		while (itr->first != -1 && itr->last != -1) {
-			if (ictx->ch >= itr->first && ictx->ch <= itr->last)
-				break;
-			itr++;
-		}
-		if (itr->first == -1 || itr->last == -1) {
+		itr = ictx->state->lookup[ictx->ch];
+		if (itr == NULL) {
 			/* No transition? Eh? */
 			fatalx("No transition from state!");
 		}
@@ -939,7 +1077,7 @@ input_c0_dispatch(struct input_ctx *ictx)
 	case '\000':	/* NUL */
 		break;
 	case '\007':	/* BEL */
-		wp->window->flags |= WINDOW_BELL;
+		server_window_alert(wp->window, WINDOW_BELL);
 		break;
 	case '\010':	/* BS */
 		screen_write_backspace(sctx);
@@ -993,14 +1131,14 @@ input_esc_dispatch(struct input_ctx *ictx)
 {
 	struct screen_write_ctx		*sctx = &ictx->ctx;
 	struct screen			*s = sctx->s;
-	struct input_table_entry	*entry;
+	const struct input_table_entry	*entry;
 
 	if (ictx->flags & INPUT_DISCARD)
 		return (0);
 	log_debug("%s: '%c', %s", __func__, ictx->ch, ictx->interm_buf);
 
-	entry = bsearch(ictx, input_esc_table, nitems(input_esc_table),
-	    sizeof input_esc_table[0], input_table_compare);
+	entry = input_table_find(ictx, input_esc_table,
+	    nitems(input_esc_table), input_esc_index);
 	if (entry == NULL) {
 		log_debug("%s: unknown '%c'", __func__, ictx->ch);
 		return (0);
@@ -1070,7 +1208,7 @@ input_csi_dispatch(struct input_ctx *ictx)
 	struct screen_write_ctx	       *sctx = &ictx->ctx;
 	struct window_pane	       *wp = ictx->wp;
 	struct screen		       *s = sctx->s;
-	struct input_table_entry       *entry;
+	const struct input_table_entry *entry;
 	int			 	n, m;
 
 	if (ictx->flags & INPUT_DISCARD)
@@ -1080,8 +1218,8 @@ input_csi_dispatch(struct input_ctx *ictx)
 	log_debug("%s: '%c' \"%s\" \"%s\"",
 	    __func__, ictx->ch, ictx->interm_buf, ictx->param_buf);
 
-	entry = bsearch(ictx, input_csi_table, nitems(input_csi_table),
-	    sizeof input_csi_table[0], input_table_compare);
+	entry = input_table_find(ictx, input_csi_table,
+	    nitems(input_csi_table), input_csi_index);
 	if (entry == NULL) {
 		log_debug("%s: unknown '%c'", __func__, ictx->ch);
 		return (0);
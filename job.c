@@ -33,8 +33,17 @@
 
 void	job_callback(struct bufferevent *, short, void *);
 
-/* All jobs list. */
+/* All jobs list, and tree of jobs still running by pid. */
 struct joblist	all_jobs = LIST_HEAD_INITIALIZER(all_jobs);
+struct job_pid_tree all_job_pids = RB_INITIALIZER(&all_job_pids);
+
+RB_GENERATE(job_pid_tree, job, pid_entry, job_pid_cmp);
+
+int
+job_pid_cmp(struct job *job1, struct job *job2)
+{
+	return (job1->pid - job2->pid);
+}
 
 /* Start a job running, if it isn't already. */
 struct job *
@@ -95,6 +104,7 @@ job_run(const char *cmd,
 	job->status = 0;
 
 	LIST_INSERT_HEAD(&all_jobs, job, lentry);
+	RB_INSERT(job_pid_tree, &all_job_pids, job);
 
 	job->callbackfn = callbackfn;
 	job->freefn = freefn;
@@ -110,6 +120,16 @@ job_run(const char *cmd,
 	return (job);
 }
 
+/* Find a running job by pid. */
+struct job *
+job_find_by_pid(pid_t pid)
+{
+	struct job	job;
+
+	job.pid = pid;
+	return (RB_FIND(job_pid_tree, &all_job_pids, &job));
+}
+
 /* Kill and free an individual job. */
 void
 job_free(struct job *job)
@@ -117,6 +137,8 @@ job_free(struct job *job)
 	log_debug("free job %p: %s", job, job->cmd);
 
 	LIST_REMOVE(job, lentry);
+	if (job->pid != -1)
+		RB_REMOVE(job_pid_tree, &all_job_pids, job);
 	free(job->cmd);
 
 	if (job->freefn != NULL && job->data != NULL)
@@ -159,11 +181,12 @@ job_died(struct job *job, int status)
 	log_debug("job died %p: %s, pid %ld", job, job->cmd, (long) job->pid);
 
 	job->status = status;
+	RB_REMOVE(job_pid_tree, &all_job_pids, job);
+	job->pid = -1;
 
 	if (job->fd == -1) {
 		if (job->callbackfn != NULL)
 			job->callbackfn(job);
 		job_free(job);
-	} else
-		job->pid = -1;
+	}
 }
@@ -217,6 +217,7 @@ layout_fix_panes(struct window *w, u_int wsx, u_int wsy)
 
 		window_pane_resize(wp, sx, sy);
 	}
+	window_map_invalidate(w);
 }
 
 /* Count the number of available cells in a layout. */
@@ -26,44 +26,96 @@
 
 #include "tmux.h"
 
-void	 window_name_callback(unused int, unused short, void *);
+void	 window_name_callback(unused int, unused short, unused void *);
+int	 window_name_check(struct window *);
 char	*parse_window_name(const char *);
 
+/*
+ * Windows are named by one timer for the whole server. Each time it fires, up
+ * to NAME_BUDGET windows are checked, carrying on from where the last pass
+ * stopped, so a server with many windows does not stall.
+ */
+struct event	name_timer;
+u_int		name_next;
+
+/* Queue a window to have its name found again on the next pass. */
 void
 queue_window_name(struct window *w)
 {
 	struct timeval	tv;
 
+	w->name_pane = UINT_MAX;
+
+	if (!event_initialized(&name_timer))
+		evtimer_set(&name_timer, window_name_callback, NULL);
+	if (evtimer_pending(&name_timer, NULL))
+		return;
+
 	tv.tv_sec = 0;
 	tv.tv_usec = NAME_INTERVAL * 1000L;
-
-	if (event_initialized(&w->name_timer))
-		evtimer_del(&w->name_timer);
-	evtimer_set(&w->name_timer, window_name_callback, w);
-	evtimer_add(&w->name_timer, &tv);
+	evtimer_add(&name_timer, &tv);
 }
 
 /* ARGSUSED */
 void
-window_name_callback(unused int fd, unused short events, void *data)
+window_name_callback(unused int fd, unused short events, unused void *data)
 {
-	struct window	*w = data;
-	char		*name, *wname;
+	struct window	*w;
+	struct timeval	 tv;
+	u_int		 n, budget, found;
+
+	found = 0;
+	budget = NAME_BUDGET;
+	for (n = 0; n < ARRAY_LENGTH(&windows) && budget != 0; n++) {
+		if (name_next >= ARRAY_LENGTH(&windows))
+			name_next = 0;
+		w = ARRAY_ITEM(&windows, name_next++);
+		if (w == NULL || w->active == NULL)
+			continue;
+		if (!options_get_number(&w->options, "automatic-rename"))
+			continue;
+		found = 1;
+		budget -= window_name_check(w);
+	}
 
-	if (w->active == NULL)
+	/* Stop when no windows are left with automatic-rename on. */
+	if (!found)
 		return;
+	tv.tv_sec = 0;
+	tv.tv_usec = NAME_INTERVAL * 1000L;
+	evtimer_add(&name_timer, &tv);
+}
 
-	if (!options_get_number(&w->options, "automatic-rename")) {
-		if (event_initialized(&w->name_timer))
-			event_del(&w->name_timer);
-		return;
-	}
-	queue_window_name(w);
+/*
+ * Find the name for a window and rename it if it has changed. The process name
+ * is only read again if the active pane, its foreground process group or its
+ * mode has changed, or there has been output in the window. Returns 1 if the
+ * name was read.
+ */
+int
+window_name_check(struct window *w)
+{
+	struct window_pane	*wp = w->active;
+	char			*name, *wname;
+	pid_t			 pgrp;
 
-	if (w->active->screen != &w->active->base)
+	if (wp->screen != &wp->base) {
+		w->name_pane = UINT_MAX;
 		name = NULL;
-	else
-		name = osdep_get_name(w->active->fd, w->active->tty);
+	} else {
+		if (wp->fd == -1)
+			pgrp = -1;
+		else
+			pgrp = tcgetpgrp(wp->fd);
+		if (w->name_pane == wp->id && w->name_pgrp == pgrp &&
+		    !(w->flags & WINDOW_NAMEOUTPUT))
+			return (0);
+		w->name_pane = wp->id;
+		w->name_pgrp = pgrp;
+		w->flags &= ~WINDOW_NAMEOUTPUT;
+
+		name = osdep_get_name(wp->fd, wp->tty);
+	}
 	if (name == NULL)
 		wname = default_window_name(w);
 	else {
@@ -72,7 +124,7 @@ window_name_callback(unused int fd, unused short events, void *data)
 		 * shell and argv[0] may have a - prefix. Remove this if it is
 		 * present. Ick.
 		 */
-		if (w->active->cmd != NULL && *w->active->cmd == '\0' &&
+		if (wp->cmd != NULL && *wp->cmd == '\0' &&
 		    name != NULL && name[0] == '-' && name[1] != '\0')
 			wname = parse_window_name(name + 1);
 		else
@@ -80,7 +132,7 @@ window_name_callback(unused int fd, unused short events, void *data)
 		free(name);
 	}
 
-	if (w->active->fd == -1) {
+	if (wp->fd == -1) {
 		xasprintf(&name, "%s[dead]", wname);
 		free(wname);
 		wname = name;
@@ -91,6 +143,7 @@ window_name_callback(unused int fd, unused short events, void *data)
 		server_status_window(w);
 	}
 	free(wname);
+	return (1);
 }
 
 char *
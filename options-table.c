@@ -50,6 +50,9 @@ const char *options_table_status_justify_list[] = {
 const char *options_table_status_position_list[] = {
 	"top", "bottom", NULL
 };
+const char *options_table_render_mode_list[] = {
+	"direct", "diff", NULL
+};
 const char *options_table_bell_action_list[] = {
 	"none", "any", "current", NULL
 };
@@ -186,6 +189,13 @@ const struct options_table_entry session_options_table[] = {
 	  .default_num = 1
 	},
 
+	{ .name = "max-fps",
+	  .type = OPTIONS_TABLE_NUMBER,
+	  .minimum = 0,
+	  .maximum = 1000,
+	  .default_num = 0
+	},
+
 	{ .name = "message-attr",
 	  .type = OPTIONS_TABLE_ATTRIBUTES,
 	  .default_num = 0
@@ -278,6 +288,12 @@ const struct options_table_entry session_options_table[] = {
 	  .default_num = 0
 	},
 
+	{ .name = "render-mode",
+	  .type = OPTIONS_TABLE_CHOICE,
+	  .choices = options_table_render_mode_list,
+	  .default_num = 0
+	},
+
 	{ .name = "repeat-time",
 	  .type = OPTIONS_TABLE_NUMBER,
 	  .minimum = 0,
@@ -509,6 +525,13 @@ const struct options_table_entry window_options_table[] = {
 	  .default_num = 0
 	},
 
+	{ .name = "history-hot-limit",
+	  .type = OPTIONS_TABLE_NUMBER,
+	  .minimum = 0,
+	  .maximum = INT_MAX,
+	  .default_num = 1000
+	},
+
 	{ .name = "layout-history-limit",
 	  .type = OPTIONS_TABLE_NUMBER,
 	  .minimum = 1,
@@ -20,6 +20,7 @@
 #include <sys/stat.h>
 
 #include <event.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -29,35 +30,29 @@
 char *
 osdep_get_name(int fd, unused char *tty)
 {
-	FILE	*f;
-	char	*path, *buf;
-	size_t	 len;
-	int	 ch;
+	char	*path, buf[MAXPATHLEN + 1];
+	ssize_t	 n;
+	int	 f;
 	pid_t	 pgrp;
 
 	if ((pgrp = tcgetpgrp(fd)) == -1)
 		return (NULL);
 
 	xasprintf(&path, "/proc/%lld/cmdline", (long long) pgrp);
-	if ((f = fopen(path, "r")) == NULL) {
+	if ((f = open(path, O_RDONLY)) == -1) {
 		free(path);
 		return (NULL);
 	}
 	free(path);
 
-	len = 0;
-	buf = NULL;
-	while ((ch = fgetc(f)) != EOF) {
-		if (ch == '\0')
-			break;
-		buf = xrealloc(buf, 1, len + 2);
-		buf[len++] = ch;
-	}
-	if (buf != NULL)
-		buf[len] = '\0';
+	/* Only argv[0] is wanted, so one read is enough. */
+	n = read(f, buf, sizeof buf - 1);
+	close(f);
+	if (n <= 0 || buf[0] == '\0')
+		return (NULL);
+	buf[n] = '\0';
 
-	fclose(f);
-	return (buf);
+	return (xstrdup(buf));
 }
 
 char *
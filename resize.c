@@ -48,8 +48,9 @@ recalculate_sizes(void)
 	struct session		*s;
 	struct client		*c;
 	struct window		*w;
+	struct winlink		*wl;
 	struct window_pane	*wp;
-	u_int		 	 i, j, ssx, ssy, has, limit;
+	u_int		 	 i, j, ssx, ssy, limit;
 	int		 	 flag;
 
 	RB_FOREACH(s, sessions, &sessions) {
@@ -94,19 +95,16 @@ recalculate_sizes(void)
 		flag = options_get_number(&w->options, "aggressive-resize");
 
 		ssx = ssy = UINT_MAX;
-		RB_FOREACH(s, sessions, &sessions) {
+		TAILQ_FOREACH(wl, &w->winlinks, wentry) {
+			s = wl->session;
 			if (s->flags & SESSION_UNATTACHED)
 				continue;
-			if (flag)
-				has = s->curw->window == w;
-			else
-				has = session_has(s, w) != NULL;
-			if (has) {
-				if (s->sx < ssx)
-					ssx = s->sx;
-				if (s->sy < ssy)
-					ssy = s->sy;
-			}
+			if (flag && s->curw->window != w)
+				continue;
+			if (s->sx < ssx)
+				ssx = s->sx;
+			if (s->sy < ssy)
+				ssy = s->sy;
 		}
 		if (ssx == UINT_MAX || ssy == UINT_MAX)
 			continue;
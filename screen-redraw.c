@@ -26,6 +26,10 @@ int	screen_redraw_cell_border1(struct window_pane *, u_int, u_int);
 int	screen_redraw_cell_border(struct client *, u_int, u_int);
 int	screen_redraw_check_cell(struct client *, u_int, u_int);
 void	screen_redraw_draw_number(struct client *, struct window_pane *);
+void	screen_redraw_border_cells(
+	    struct options *, struct grid_cell *, struct grid_cell *);
+void	screen_redraw_frame_line(
+	    struct tty *, struct screen *, u_int, u_int, u_int);
 
 #define CELL_INSIDE 0
 #define CELL_LEFTRIGHT 1
@@ -76,90 +80,67 @@ screen_redraw_cell_border1(struct window_pane *wp, u_int px, u_int py)
 int
 screen_redraw_cell_border(struct client *c, u_int px, u_int py)
 {
-	struct window		*w = c->session->curw->window;
-	struct window_pane	*wp;
-	int			 retval;
-
-	/* Check all the panes. */
-	TAILQ_FOREACH(wp, &w->panes, entry) {
-		if (!window_pane_visible(wp))
-			continue;
-		if ((retval = screen_redraw_cell_border1(wp, px, py)) != -1)
-			return (retval);
-	}
+	struct window	*w = c->session->curw->window;
 
-	return (0);
+	return (window_map_cell(w, px, py) == WINDOW_MAP_BORDER);
 }
 
 /* Check if cell inside a pane. */
 int
 screen_redraw_check_cell(struct client *c, u_int px, u_int py)
 {
-	struct window		*w = c->session->curw->window;
-	struct window_pane	*wp;
-	int			 borders;
+	struct window	*w = c->session->curw->window;
+	int		 borders;
 
-	if (px > w->sx || py > w->sy)
+	switch (window_map_cell(w, px, py)) {
+	case WINDOW_MAP_OUTSIDE:
 		return (CELL_OUTSIDE);
+	case WINDOW_MAP_INSIDE:
+		return (CELL_INSIDE);
+	}
 
-	TAILQ_FOREACH(wp, &w->panes, entry) {
-		if (!window_pane_visible(wp))
-			continue;
-
-		/* If outside the pane and its border, skip it. */
-		if ((wp->xoff != 0 && px < wp->xoff - 1) ||
-		    px > wp->xoff + wp->sx ||
-		    (wp->yoff != 0 && py < wp->yoff - 1) ||
-		    py > wp->yoff + wp->sy)
-			continue;
-
-		/* If definitely inside, return so. */
-		if (!screen_redraw_cell_border(c, px, py))
-			return (CELL_INSIDE);
-
-		/*
-		 * Construct a bitmask of whether the cells to the left (bit
-		 * 4), right, top, and bottom (bit 1) of this cell are borders.
-		 */
-		borders = 0;
-		if (px == 0 || screen_redraw_cell_border(c, px - 1, py))
-			borders |= 8;
-		if (px <= w->sx && screen_redraw_cell_border(c, px + 1, py))
-			borders |= 4;
-		if (py == 0 || screen_redraw_cell_border(c, px, py - 1))
-			borders |= 2;
-		if (py <= w->sy && screen_redraw_cell_border(c, px, py + 1))
-			borders |= 1;
-
-		/*
-		 * Figure out what kind of border this cell is. Only one bit
-		 * set doesn't make sense (can't have a border cell with no
-		 * others connected).
-		 */
-		switch (borders) {
-		case 15:	/* 1111, left right top bottom */
-			return (CELL_JOIN);
-		case 14:	/* 1110, left right top */
-			return (CELL_BOTTOMJOIN);
-		case 13:	/* 1101, left right bottom */
-			return (CELL_TOPJOIN);
-		case 12:	/* 1100, left right */
-			return (CELL_TOPBOTTOM);
-		case 11:	/* 1011, left top bottom */
-			return (CELL_RIGHTJOIN);
-		case 10:	/* 1010, left top */
-			return (CELL_BOTTOMRIGHT);
-		case 9:		/* 1001, left bottom */
-			return (CELL_TOPRIGHT);
-		case 7:		/* 0111, right top bottom */
-			return (CELL_LEFTJOIN);
-		case 6:		/* 0110, right top */
-			return (CELL_BOTTOMLEFT);
-		case 5:		/* 0101, right bottom */
-			return (CELL_TOPLEFT);
-		case 3:		/* 0011, top bottom */
-			return (CELL_LEFTRIGHT);
-		}
+	/*
+	 * Construct a bitmask of whether the cells to the left (bit 4), right,
+	 * top, and bottom (bit 1) of this cell are borders.
+	 */
+	borders = 0;
+	if (px == 0 || screen_redraw_cell_border(c, px - 1, py))
+		borders |= 8;
+	if (px <= w->sx && screen_redraw_cell_border(c, px + 1, py))
+		borders |= 4;
+	if (py == 0 || screen_redraw_cell_border(c, px, py - 1))
+		borders |= 2;
+	if (py <= w->sy && screen_redraw_cell_border(c, px, py + 1))
+		borders |= 1;
+
+	/*
+	 * Figure out what kind of border this cell is. Only one bit set
+	 * doesn't make sense (can't have a border cell with no others
+	 * connected).
+	 */
+	switch (borders) {
+	case 15:	/* 1111, left right top bottom */
+		return (CELL_JOIN);
+	case 14:	/* 1110, left right top */
+		return (CELL_BOTTOMJOIN);
+	case 13:	/* 1101, left right bottom */
+		return (CELL_TOPJOIN);
+	case 12:	/* 1100, left right */
+		return (CELL_TOPBOTTOM);
+	case 11:	/* 1011, left top bottom */
+		return (CELL_RIGHTJOIN);
+	case 10:	/* 1010, left top */
+		return (CELL_BOTTOMRIGHT);
+	case 9:		/* 1001, left bottom */
+		return (CELL_TOPRIGHT);
+	case 7:		/* 0111, right top bottom */
+		return (CELL_LEFTJOIN);
+	case 6:		/* 0110, right top */
+		return (CELL_BOTTOMLEFT);
+	case 5:		/* 0101, right bottom */
+		return (CELL_TOPLEFT);
+	case 3:		/* 0011, top bottom */
+		return (CELL_LEFTRIGHT);
 	}
 
 	return (CELL_OUTSIDE);
@@ -175,7 +156,7 @@ screen_redraw_screen(struct client *c, int status_only, int borders_only)
 	struct window_pane	*wp;
 	struct grid_cell	 active_gc, other_gc;
 	u_int		 	 i, j, type, top;
-	int		 	 status, spos, fg, bg;
+	int		 	 status, spos;
 
 	/* Suspended clients should not be updated. */
 	if (c->flags & CLIENT_SUSPENDED)
@@ -202,17 +183,7 @@ screen_redraw_screen(struct client *c, int status_only, int borders_only)
 	}
 
 	/* Set up pane border attributes. */
-	memcpy(&other_gc, &grid_marker_cell, sizeof other_gc);
-	memcpy(&active_gc, &grid_marker_cell, sizeof active_gc);
-	active_gc.attr = other_gc.attr = GRID_ATTR_CHARSET;
-	fg = options_get_number(oo, "pane-border-fg");
-	colour_set_fg(&other_gc, fg);
-	bg = options_get_number(oo, "pane-border-bg");
-	colour_set_bg(&other_gc, bg);
-	fg = options_get_number(oo, "pane-active-border-fg");
-	colour_set_fg(&active_gc, fg);
-	bg = options_get_number(oo, "pane-active-border-bg");
-	colour_set_bg(&active_gc, bg);
+	screen_redraw_border_cells(oo, &active_gc, &other_gc);
 
 	/* Draw background and borders. */
 	for (j = 0; j < tty->sy - status; j++) {
@@ -267,6 +238,137 @@ screen_redraw_screen(struct client *c, int status_only, int borders_only)
 	tty_reset(tty);
 }
 
+/* Set up the cells used for the active and other pane borders. */
+void
+screen_redraw_border_cells(struct options *oo, struct grid_cell *active_gc,
+    struct grid_cell *other_gc)
+{
+	int	fg, bg;
+
+	memcpy(other_gc, &grid_marker_cell, sizeof *other_gc);
+	memcpy(active_gc, &grid_marker_cell, sizeof *active_gc);
+	active_gc->attr = other_gc->attr = GRID_ATTR_CHARSET;
+	fg = options_get_number(oo, "pane-border-fg");
+	colour_set_fg(other_gc, fg);
+	bg = options_get_number(oo, "pane-border-bg");
+	colour_set_bg(other_gc, bg);
+	fg = options_get_number(oo, "pane-active-border-fg");
+	colour_set_fg(active_gc, fg);
+	bg = options_get_number(oo, "pane-active-border-bg");
+	colour_set_bg(active_gc, bg);
+}
+
+/*
+ * Build the whole client screen into its frame and draw what differs from the
+ * terminal, for render-mode diff.
+ */
+void
+screen_redraw_frame(struct client *c)
+{
+	struct window		*w = c->session->curw->window;
+	struct options		*oo = &c->session->options;
+	struct tty		*tty = &c->tty;
+	struct window_pane	*wp;
+	struct grid_cell	 active_gc, other_gc, *frame, *gc;
+	u_int		 	 i, j, type, top;
+	int		 	 status, spos;
+
+	if (c->flags & CLIENT_SUSPENDED)
+		return;
+
+	/*
+	 * Pane numbers are drawn straight to the terminal, so draw it all. The
+	 * shadow is no longer right so is invalidated first, so the cursor is
+	 * not moved by writing what it thinks is there.
+	 */
+	if (c->flags & CLIENT_IDENTIFY) {
+		tty_frame_invalidate(tty);
+		screen_redraw_screen(c, 0, 0);
+		return;
+	}
+
+	spos = options_get_number(oo, "status-position");
+	if (c->message_string != NULL || c->prompt_string != NULL)
+		status = 1;
+	else
+		status = options_get_number(oo, "status");
+	top = 0;
+	if (status && spos == 0)
+		top = 1;
+
+	frame = tty_frame_start(tty);
+
+	/* Fill in the borders. */
+	screen_redraw_border_cells(oo, &active_gc, &other_gc);
+	for (j = 0; j < tty->sy - status; j++) {
+		for (i = 0; i < tty->sx; i++) {
+			type = screen_redraw_check_cell(c, i, j);
+			if (type == CELL_INSIDE)
+				continue;
+			gc = &frame[(top + j) * tty->sx + i];
+			if (screen_redraw_cell_border1(w->active, i, j) == 1)
+				memcpy(gc, &active_gc, sizeof *gc);
+			else
+				memcpy(gc, &other_gc, sizeof *gc);
+			gc->data = CELL_BORDERS[type];
+		}
+	}
+
+	/* Fill in the panes. */
+	TAILQ_FOREACH(wp, &w->panes, entry) {
+		if (!window_pane_visible(wp))
+			continue;
+		for (i = 0; i < wp->sy; i++) {
+			screen_redraw_frame_line(
+			    tty, wp->screen, i, wp->xoff, top + wp->yoff);
+		}
+	}
+
+	/* And the status line. */
+	if (status) {
+		if (top)
+			screen_redraw_frame_line(tty, &c->status, 0, 0, 0);
+		else
+			screen_redraw_frame_line(
+			    tty, &c->status, 0, 0, tty->sy - 1);
+	}
+
+	tty_draw_frame(tty, w->active->screen);
+}
+
+/* Copy a screen line into the frame, as tty_draw_line would draw it. */
+void
+screen_redraw_frame_line(
+    struct tty *tty, struct screen *s, u_int py, u_int ox, u_int oy)
+{
+	const struct grid_cell	*gc;
+	struct grid_cell	*fc;
+	u_int			 i, sx;
+
+	if (oy + py >= tty->sy || py >= screen_size_y(s))
+		return;
+
+	sx = screen_size_x(s);
+	if (sx > grid_get_line(s->grid, s->grid->hsize + py)->cellsize)
+		sx = grid_get_line(s->grid, s->grid->hsize + py)->cellsize;
+	if (ox + sx > tty->sx)
+		sx = ox < tty->sx ? tty->sx - ox : 0;
+
+	fc = &tty->frame[(oy + py) * tty->sx + ox];
+	for (i = 0; i < sx; i++, fc++) {
+		gc = grid_view_peek_cell(s->grid, i, py);
+		memcpy(fc, gc, sizeof *fc);
+		if (screen_check_selection(s, i, py)) {
+			memcpy(fc, &s->sel.cell, sizeof *fc);
+			fc->data = gc->data;
+			fc->flags = gc->flags &
+			    ~(GRID_FLAG_FG256|GRID_FLAG_BG256);
+			fc->flags |= s->sel.cell.flags &
+			    (GRID_FLAG_FG256|GRID_FLAG_BG256);
+		}
+	}
+}
+
 /* Draw a single pane. */
 void
 screen_redraw_pane(struct client *c, struct window_pane *wp)
@@ -282,6 +384,24 @@ screen_redraw_pane(struct client *c, struct window_pane *wp)
 	tty_reset(&c->tty);
 }
 
+/* Draw only the lines of a pane which have changed since it was last drawn. */
+void
+screen_redraw_changed(struct client *c, struct window_pane *wp)
+{
+	struct screen	*s = wp->screen;
+	u_int		 i, yoff;
+
+	yoff = wp->yoff;
+	if (status_at_line(c) == 0)
+		yoff++;
+
+	for (i = 0; i < wp->sy && i < screen_size_y(s); i++) {
+		if (bit_test(s->dirty, i))
+			tty_draw_line(&c->tty, s, i, wp->xoff, yoff);
+	}
+	tty_reset(&c->tty);
+}
+
 /* Draw number on a pane. */
 void
 screen_redraw_draw_number(struct client *c, struct window_pane *wp)
@@ -372,14 +372,12 @@ screen_write_copy(struct screen_write_ctx *ctx,
 	struct grid		*gd = src->grid;
 	struct grid_line	*gl;
 	const struct grid_cell	*gc;
-	const struct grid_utf8	*gu;
-	struct utf8_data	 utf8data;
 	u_int		 	 xx, yy, cx, cy, ax, bx;
 
 	cx = s->cx;
 	cy = s->cy;
 	for (yy = py; yy < py + ny; yy++) {
-		gl = &gd->linedata[yy];
+		gl = grid_get_line(gd, yy);
 		if (yy < gd->hsize + gd->sy) {
 			/*
 			 * Find start and end position and copy between
@@ -401,16 +399,7 @@ screen_write_copy(struct screen_write_ctx *ctx,
 					gc = &grid_default_cell;
 				else
 					gc = &gl->celldata[xx];
-				if (!(gc->flags & GRID_FLAG_UTF8)) {
-					screen_write_cell(ctx, gc, NULL);
-					continue;
-				}
-				/* Reinject the UTF-8 sequence. */
-				gu = &gl->utf8data[xx];
-				utf8data.size = grid_utf8_copy(
-				    gu, utf8data.data, sizeof utf8data.data);
-				utf8data.width = gu->width;
-				screen_write_cell(ctx, gc, &utf8data);
+				screen_write_cell(ctx, gc, NULL);
 			}
 			if (px + nx == gd->sx && px + nx > gl->cellsize)
 				screen_write_clearendofline(ctx);
@@ -429,7 +418,6 @@ screen_write_initctx(
 	struct screen		*s = ctx->s;
 	struct grid		*gd = s->grid;
 	const struct grid_cell	*gc;
-	const struct grid_utf8	*gu;
 	u_int			 xx;
 
 	ttyctx->wp = ctx->wp;
@@ -452,10 +440,6 @@ screen_write_initctx(
 	}
 	ttyctx->last_width = xx;
 	memcpy(&ttyctx->last_cell, gc, sizeof ttyctx->last_cell);
-	if (gc->flags & GRID_FLAG_UTF8) {
-		gu = grid_view_peek_utf8(gd, screen_size_x(s) - xx, s->cy);
-		memcpy(&ttyctx->last_utf8, gu, sizeof ttyctx->last_utf8);
-	}
 }
 
 /* Cursor up by ny. */
@@ -550,7 +534,7 @@ screen_write_backspace(struct screen_write_ctx *ctx)
 	if (s->cx == 0) {
 		if (s->cy == 0)
 			return;
-		gl = &s->grid->linedata[s->grid->hsize + s->cy - 1];
+		gl = grid_get_line(s->grid, s->grid->hsize + s->cy - 1);
 		if (gl->flags & GRID_LINE_WRAPPED) {
 			s->cy--;
 			s->cx = screen_size_x(s) - 1;
@@ -577,6 +561,7 @@ screen_write_alignmenttest(struct screen_write_ctx *ctx)
 		for (xx = 0; xx < screen_size_x(s); xx++)
 			grid_view_set_cell(s->grid, xx, yy, &gc);
 	}
+	screen_dirty_lines(s, 0, screen_size_y(s));
 
 	s->cx = 0;
 	s->cy = 0;
@@ -607,6 +592,7 @@ screen_write_insertcharacter(struct screen_write_ctx *ctx, u_int nx)
 
 	if (s->cx <= screen_size_x(s) - 1)
 		grid_view_insert_cells(s->grid, s->cx, s->cy, nx);
+	screen_dirty_lines(s, s->cy, 1);
 
 	ttyctx.num = nx;
 	tty_write(tty_cmd_insertcharacter, &ttyctx);
@@ -631,6 +617,7 @@ screen_write_deletecharacter(struct screen_write_ctx *ctx, u_int nx)
 
 	if (s->cx <= screen_size_x(s) - 1)
 		grid_view_delete_cells(s->grid, s->cx, s->cy, nx);
+	screen_dirty_lines(s, s->cy, 1);
 
 	ttyctx.num = nx;
 	tty_write(tty_cmd_deletecharacter, &ttyctx);
@@ -655,6 +642,7 @@ screen_write_insertline(struct screen_write_ctx *ctx, u_int ny)
 		screen_write_initctx(ctx, &ttyctx, 0);
 
 		grid_view_insert_lines(s->grid, s->cy, ny);
+		screen_dirty_lines(s, s->cy, screen_size_y(s) - s->cy);
 
 		ttyctx.num = ny;
 		tty_write(tty_cmd_insertline, &ttyctx);
@@ -672,6 +660,7 @@ screen_write_insertline(struct screen_write_ctx *ctx, u_int ny)
 		grid_view_insert_lines(s->grid, s->cy, ny);
 	else
 		grid_view_insert_lines_region(s->grid, s->rlower, s->cy, ny);
+	screen_dirty_lines(s, s->cy, s->rlower + 1 - s->cy);
 
 	ttyctx.num = ny;
 	tty_write(tty_cmd_insertline, &ttyctx);
@@ -696,6 +685,7 @@ screen_write_deleteline(struct screen_write_ctx *ctx, u_int ny)
 		screen_write_initctx(ctx, &ttyctx, 0);
 
 		grid_view_delete_lines(s->grid, s->cy, ny);
+		screen_dirty_lines(s, s->cy, screen_size_y(s) - s->cy);
 
 		ttyctx.num = ny;
 		tty_write(tty_cmd_deleteline, &ttyctx);
@@ -713,6 +703,7 @@ screen_write_deleteline(struct screen_write_ctx *ctx, u_int ny)
 		grid_view_delete_lines(s->grid, s->cy, ny);
 	else
 		grid_view_delete_lines_region(s->grid, s->rlower, s->cy, ny);
+	screen_dirty_lines(s, s->cy, s->rlower + 1 - s->cy);
 
 	ttyctx.num = ny;
 	tty_write(tty_cmd_deleteline, &ttyctx);
@@ -728,6 +719,7 @@ screen_write_clearline(struct screen_write_ctx *ctx)
 	screen_write_initctx(ctx, &ttyctx, 0);
 
 	grid_view_clear(s->grid, 0, s->cy, screen_size_x(s), 1);
+	screen_dirty_lines(s, s->cy, 1);
 
 	tty_write(tty_cmd_clearline, &ttyctx);
 }
@@ -746,6 +738,7 @@ screen_write_clearendofline(struct screen_write_ctx *ctx)
 
 	if (s->cx <= sx - 1)
 		grid_view_clear(s->grid, s->cx, s->cy, sx - s->cx, 1);
+	screen_dirty_lines(s, s->cy, 1);
 
 	tty_write(tty_cmd_clearendofline, &ttyctx);
 }
@@ -766,6 +759,7 @@ screen_write_clearstartofline(struct screen_write_ctx *ctx)
 		grid_view_clear(s->grid, 0, s->cy, sx, 1);
 	else
 		grid_view_clear(s->grid, 0, s->cy, s->cx + 1, 1);
+	screen_dirty_lines(s, s->cy, 1);
 
 	tty_write(tty_cmd_clearstartofline, &ttyctx);
 }
@@ -806,9 +800,10 @@ screen_write_reverseindex(struct screen_write_ctx *ctx)
 
 	screen_write_initctx(ctx, &ttyctx, 0);
 
-	if (s->cy == s->rupper)
+	if (s->cy == s->rupper) {
 		grid_view_scroll_region_down(s->grid, s->rupper, s->rlower);
-	else if (s->cy > 0)
+		screen_scroll_lines(s, s->rupper, s->rlower, 0);
+	} else if (s->cy > 0)
 		s->cy--;
 
 	tty_write(tty_cmd_reverseindex, &ttyctx);
@@ -901,15 +896,18 @@ screen_write_linefeed(struct screen_write_ctx *ctx, int wrapped)
 
 	screen_write_initctx(ctx, &ttyctx, 0);
 
-	gl = &s->grid->linedata[s->grid->hsize + s->cy];
+	gl = grid_get_line(s->grid, s->grid->hsize + s->cy);
 	if (wrapped)
 		gl->flags |= GRID_LINE_WRAPPED;
 	else
 		gl->flags &= ~GRID_LINE_WRAPPED;
 
-	if (s->cy == s->rlower)
+	if (s->cy == s->rlower) {
 		grid_view_scroll_region_up(s->grid, s->rupper, s->rlower);
-	else if (s->cy < screen_size_y(s) - 1)
+		screen_scroll_lines(s, s->rupper, s->rlower, 1);
+		if (ctx->wp != NULL)
+			ctx->wp->scrolled++;
+	} else if (s->cy < screen_size_y(s) - 1)
 		s->cy++;
 
 	ttyctx.num = wrapped;
@@ -970,6 +968,7 @@ screen_write_clearendofscreen(struct screen_write_ctx *ctx)
 			grid_view_clear(s->grid, s->cx, s->cy, sx - s->cx, 1);
 		grid_view_clear(s->grid, 0, s->cy + 1, sx, sy - (s->cy + 1));
 	}
+	screen_dirty_lines(s, s->cy, sy - s->cy);
 
 	tty_write(tty_cmd_clearendofscreen, &ttyctx);
 }
@@ -992,6 +991,7 @@ screen_write_clearstartofscreen(struct screen_write_ctx *ctx)
 		grid_view_clear(s->grid, 0, s->cy, sx, 1);
 	else
 		grid_view_clear(s->grid, 0, s->cy, s->cx + 1, 1);
+	screen_dirty_lines(s, 0, s->cy + 1);
 
 	tty_write(tty_cmd_clearstartofscreen, &ttyctx);
 }
@@ -1012,6 +1012,7 @@ screen_write_clearscreen(struct screen_write_ctx *ctx)
 		grid_view_clear(
 		    s->grid, 0, 0, screen_size_x(s), screen_size_y(s));
 	}
+	screen_dirty_lines(s, 0, screen_size_y(s));
 
 	tty_write(tty_cmd_clearscreen, &ttyctx);
 }
@@ -1020,14 +1021,13 @@ screen_write_clearscreen(struct screen_write_ctx *ctx)
 void
 screen_write_clearhistory(struct screen_write_ctx *ctx)
 {
-	struct screen	*s = ctx->s;
-	struct grid	*gd = s->grid;
-
-	grid_move_lines(gd, 0, gd->hsize, gd->sy);
-	gd->hsize = 0;
+	grid_clear_history(ctx->s->grid);
 }
 
-/* Write cell data. */
+/*
+ * Write cell data. For a UTF-8 cell, the character is taken from utf8data or,
+ * if that is NULL, the cell is already complete (copied from another grid).
+ */
 void
 screen_write_cell(struct screen_write_ctx *ctx,
     const struct grid_cell *gc, const struct utf8_data *utf8data)
@@ -1035,9 +1035,8 @@ screen_write_cell(struct screen_write_ctx *ctx,
 	struct screen		*s = ctx->s;
 	struct grid		*gd = s->grid;
 	struct tty_ctx		 ttyctx;
-	struct grid_utf8	 gu;
 	u_int		 	 width, xx;
-	struct grid_cell 	 tmp_gc, *tmp_gcp;
+	struct grid_cell 	 tmp_gc, utf8_gc, *tmp_gcp;
 	int			 insert = 0;
 
 	/* Ignore padding. */
@@ -1045,10 +1044,10 @@ screen_write_cell(struct screen_write_ctx *ctx,
 		return;
 
 	/* Find character width. */
-	if (gc->flags & GRID_FLAG_UTF8)
+	if (gc->flags & GRID_FLAG_UTF8 && utf8data != NULL)
 		width = utf8data->width;
 	else
-		width = 1;
+		width = grid_cell_width(gc);
 
 	/*
 	 * If this is a wide character and there is no room on the screen, for
@@ -1066,12 +1065,20 @@ screen_write_cell(struct screen_write_ctx *ctx,
 	 */
 	if (width == 0) {
 		if (screen_write_combine(ctx, utf8data) == 0) {
+			screen_dirty_lines(s, s->cy, 1);
 			screen_write_initctx(ctx, &ttyctx, 0);
 			tty_write(tty_cmd_utf8character, &ttyctx);
 		}
 		return;
 	}
 
+	/* Construct the UTF-8 cell. */
+	if (gc->flags & GRID_FLAG_UTF8 && utf8data != NULL) {
+		memcpy(&utf8_gc, gc, sizeof utf8_gc);
+		grid_utf8_set(&utf8_gc, utf8data);
+		gc = &utf8_gc;
+	}
+
 	/* Initialise the redraw context, saving the last cell. */
 	screen_write_initctx(ctx, &ttyctx, 1);
 
@@ -1079,6 +1086,7 @@ screen_write_cell(struct screen_write_ctx *ctx,
 	if ((s->mode & MODE_INSERT) && s->cx <= screen_size_x(s) - width) {
 		xx = screen_size_x(s) - s->cx - width;
 		grid_move_cells(s->grid, s->cx + width, s->cx, s->cy, xx);
+		screen_dirty_lines(s, s->cy, 1);
 		insert = 1;
 	}
 
@@ -1108,11 +1116,7 @@ screen_write_cell(struct screen_write_ctx *ctx,
 
 	/* Set the cell. */
 	grid_view_set_cell(gd, s->cx, s->cy, gc);
-	if (gc->flags & GRID_FLAG_UTF8) {
-		/* Construct UTF-8 and write it. */
-		grid_utf8_set(&gu, utf8data);
-		grid_view_set_utf8(gd, s->cx, s->cy, &gu);
-	}
+	screen_dirty_lines(s, s->cy, 1);
 
 	/* Move the cursor. */
 	s->cx += width;
@@ -1122,7 +1126,6 @@ screen_write_cell(struct screen_write_ctx *ctx,
 		ttyctx.num = width;
 		tty_write(tty_cmd_insertcharacter, &ttyctx);
 	}
-	ttyctx.utf8 = &gu;
 	if (screen_check_selection(s, s->cx - width, s->cy)) {
 		memcpy(&tmp_gc, &s->sel.cell, sizeof tmp_gc);
 		tmp_gc.data = gc->data;
@@ -1138,6 +1141,62 @@ screen_write_cell(struct screen_write_ctx *ctx,
 	}
 }
 
+/*
+ * Write a run of printable ASCII characters which share the same attributes.
+ * Each part of the run that fits on the current line is written to the grid
+ * and the terminal in one go. Anything unusual goes through screen_write_cell.
+ */
+void
+screen_write_cells(struct screen_write_ctx *ctx, const struct grid_cell *gc,
+    const u_char *buf, u_int len)
+{
+	struct screen		*s = ctx->s;
+	struct tty_ctx		 ttyctx;
+	struct grid_cell	 tmp_gc;
+	u_int			 sx, n;
+
+	memcpy(&tmp_gc, gc, sizeof tmp_gc);
+
+	if (!(s->mode & MODE_WRAP) || s->mode & MODE_INSERT || s->sel.flag ||
+	    gc->flags & (GRID_FLAG_UTF8|GRID_FLAG_PADDING)) {
+		for (; len > 0; len--) {
+			tmp_gc.data = *buf++;
+			screen_write_cell(ctx, &tmp_gc, NULL);
+		}
+		return;
+	}
+
+	sx = screen_size_x(s);
+	while (len > 0) {
+		/* At the end of the line, let the first cell do the wrap. */
+		if (s->cx >= sx) {
+			tmp_gc.data = *buf++;
+			len--;
+			screen_write_cell(ctx, &tmp_gc, NULL);
+			continue;
+		}
+
+		n = sx - s->cx;
+		if (n > len)
+			n = len;
+
+		screen_write_initctx(ctx, &ttyctx, 0);
+
+		screen_write_overwrite(ctx, n);
+		grid_view_set_cells(s->grid, s->cx, s->cy, gc, buf, n);
+		screen_dirty_lines(s, s->cy, 1);
+		s->cx += n;
+
+		ttyctx.cell = gc;
+		ttyctx.ptr = (void *) buf;
+		ttyctx.num = n;
+		tty_write(tty_cmd_cells, &ttyctx);
+
+		buf += n;
+		len -= n;
+	}
+}
+
 /* Combine a UTF-8 zero-width character onto the previous. */
 int
 screen_write_combine(
@@ -1146,8 +1205,8 @@ screen_write_combine(
 	struct screen		*s = ctx->s;
 	struct grid		*gd = s->grid;
 	struct grid_cell	*gc;
-	struct grid_utf8	*gu, tmp_gu;
-	u_int			 i;
+	struct grid_utf8	 gu;
+	u_int			 i, width;
 
 	/* Can't combine if at 0. */
 	if (s->cx == 0)
@@ -1160,27 +1219,27 @@ screen_write_combine(
 	/* Retrieve the previous cell and convert to UTF-8 if not already. */
 	gc = grid_view_get_cell(gd, s->cx - 1, s->cy);
 	if (!(gc->flags & GRID_FLAG_UTF8)) {
-		tmp_gu.data[0] = gc->data;
-		tmp_gu.data[1] = 0xff;
-		tmp_gu.width = 1;
+		gu.data[0] = gc->data;
+		gu.data[1] = 0xff;
+		gu.width = 1;
 
-		grid_view_set_utf8(gd, s->cx - 1, s->cy, &tmp_gu);
-		gc->flags |= GRID_FLAG_UTF8;
+		grid_utf8_put(gc, &gu);
 	}
 
 	/* Append the current cell. */
-	gu = grid_view_get_utf8(gd, s->cx - 1, s->cy);
-	if (grid_utf8_append(gu, utf8data) != 0) {
+	if (grid_utf8_append(gc, utf8data) != 0) {
 		/* Failed: scrap this character and replace with underscores. */
-		if (gu->width == 1) {
+		width = grid_cell_width(gc);
+		if (width == 1) {
 			gc->data = '_';
 			gc->flags &= ~GRID_FLAG_UTF8;
 		} else {
-			for (i = 0; i < gu->width && i != sizeof gu->data; i++)
-				gu->data[i] = '_';
-			if (i != sizeof gu->data)
-				gu->data[i] = 0xff;
-			gu->width = i;
+			for (i = 0; i < width; i++)
+				gu.data[i] = '_';
+			gu.data[i] = 0xff;
+			gu.width = width;
+
+			grid_utf8_put(gc, &gu);
 		}
 	}
 
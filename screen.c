@@ -27,6 +27,7 @@
 
 void	screen_resize_x(struct screen *, u_int);
 void	screen_resize_y(struct screen *, u_int);
+u_int	screen_unsearched_bit(struct screen *, u_int);
 
 /* Create a new screen. */
 void
@@ -44,6 +45,8 @@ screen_init(struct screen *s, u_int sx, u_int sy, u_int hlimit)
 	s->cstyle = 0;
 	s->ccolour = xstrdup("");
 	s->tabs = NULL;
+	s->dirty = NULL;
+	s->unsearched = NULL;
 
 	screen_reinit(s);
 }
@@ -61,6 +64,7 @@ screen_reinit(struct screen *s)
 	s->mode = MODE_CURSOR | MODE_WRAP;
 
 	screen_reset_tabs(s);
+	screen_reset_dirty(s);
 
 	grid_clear_lines(s->grid, s->grid->hsize, s->grid->sy);
 
@@ -72,6 +76,8 @@ void
 screen_free(struct screen *s)
 {
 	free(s->tabs);
+	free(s->dirty);
+	free(s->unsearched);
 	free(s->title);
 	free(s->ccolour);
 	grid_destroy(s->grid);
@@ -91,6 +97,131 @@ screen_reset_tabs(struct screen *s)
 		bit_set(s->tabs, i);
 }
 
+/*
+ * Reallocate the dirty line maps and mark every line to be redrawn. Nothing
+ * new has been written, so no lines are left to search for content: the window
+ * is not queued for alerts to clear them again.
+ */
+void
+screen_reset_dirty(struct screen *s)
+{
+	free(s->dirty);
+	free(s->unsearched);
+
+	if ((s->dirty = bit_alloc(screen_size_y(s))) == NULL)
+		fatal("bit_alloc failed");
+	bit_nset(s->dirty, 0, screen_size_y(s) - 1);
+
+	if ((s->unsearched = bit_alloc(screen_size_y(s))) == NULL)
+		fatal("bit_alloc failed");
+	s->unsearched_top = 0;
+}
+
+/* Mark ny lines from py as changed. */
+void
+screen_dirty_lines(struct screen *s, u_int py, u_int ny)
+{
+	if (py >= screen_size_y(s) || ny == 0)
+		return;
+	if (ny > screen_size_y(s) - py)
+		ny = screen_size_y(s) - py;
+
+	if (ny == 1)
+		bit_set(s->dirty, py);
+	else
+		bit_nset(s->dirty, py, py + ny - 1);
+	screen_set_unsearched(s, py, ny);
+}
+
+/* Mark all lines as up to date on the terminal. */
+void
+screen_clear_dirty(struct screen *s)
+{
+	bit_nclear(s->dirty, 0, screen_size_y(s) - 1);
+}
+
+/*
+ * The map of unsearched lines is a ring starting at unsearched_top, so that
+ * scrolling the whole screen only needs to move the top rather than every line.
+ * Find the bit for a line.
+ */
+u_int
+screen_unsearched_bit(struct screen *s, u_int py)
+{
+	py += s->unsearched_top;
+	if (py >= screen_size_y(s))
+		py -= screen_size_y(s);
+	return (py);
+}
+
+/* Mark ny lines from py as not searched. */
+void
+screen_set_unsearched(struct screen *s, u_int py, u_int ny)
+{
+	u_int	sy = screen_size_y(s);
+
+	py = screen_unsearched_bit(s, py);
+	if (ny == 1)
+		bit_set(s->unsearched, py);
+	else if (py + ny <= sy)
+		bit_nset(s->unsearched, py, py + ny - 1);
+	else {
+		bit_nset(s->unsearched, py, sy - 1);
+		bit_nset(s->unsearched, 0, py + ny - sy - 1);
+	}
+}
+
+/* Check if a line has changed since it was last searched. */
+int
+screen_line_unsearched(struct screen *s, u_int py)
+{
+	return (bit_test(s->unsearched, screen_unsearched_bit(s, py)));
+}
+
+/* Mark all lines as searched. */
+void
+screen_clear_unsearched(struct screen *s)
+{
+	bit_nclear(s->unsearched, 0, screen_size_y(s) - 1);
+}
+
+/*
+ * Mark lines changed by scrolling a region up or down one line. The whole
+ * region must be drawn again, but only the new line needs to be searched: the
+ * others have moved, so their unsearched state moves with them.
+ */
+void
+screen_scroll_lines(struct screen *s, u_int rupper, u_int rlower, int up)
+{
+	u_int	sy = screen_size_y(s), py, from, to;
+
+	bit_nset(s->dirty, rupper, rlower);
+
+	if (rupper == 0 && rlower == sy - 1) {
+		if (up)
+			s->unsearched_top = screen_unsearched_bit(s, 1);
+		else
+			s->unsearched_top = screen_unsearched_bit(s, sy - 1);
+	} else {
+		for (py = rupper; py < rlower; py++) {
+			if (up) {
+				from = screen_unsearched_bit(s, py + 1);
+				to = screen_unsearched_bit(s, py);
+			} else {
+				from = screen_unsearched_bit(s,
+				    rupper + rlower - py - 1);
+				to = screen_unsearched_bit(s,
+				    rupper + rlower - py);
+			}
+			if (bit_test(s->unsearched, from))
+				bit_set(s->unsearched, to);
+			else
+				bit_clear(s->unsearched, to);
+		}
+	}
+	screen_set_unsearched(s, up ? rlower : rupper, 1);
+}
+
 /* Set screen cursor style. */
 void
 screen_set_cursor_style(struct screen *s, u_int style)
@@ -141,6 +272,9 @@ screen_resize(struct screen *s, u_int sx, u_int sy)
 
 	if (sy != screen_size_y(s))
 		screen_resize_y(s, sy);
+
+	/* Every line must be redrawn at the new size. */
+	screen_reset_dirty(s);
 }
 
 void
@@ -214,11 +348,13 @@ screen_resize_y(struct screen *s, u_int sy)
 			grid_view_delete_lines(gd, 0, available);
 		}
 		s->cy -= needed;
+
+		/* Compress any lines pushed out of the hot history. */
+		grid_compress_history(gd);
 	}
 
 	/* Resize line arrays. */
-	gd->linedata = xrealloc(
-	    gd->linedata, gd->hsize + sy, sizeof *gd->linedata);
+	grid_expand_lines(gd, gd->hsize + sy);
 
 	/* Size increasing. */
 	if (sy > oldy) {
@@ -240,7 +376,7 @@ screen_resize_y(struct screen *s, u_int sy)
 
 		/* Then fill the rest in with blanks. */
 		for (i = gd->hsize + sy - needed; i < gd->hsize + sy; i++)
-			memset(&gd->linedata[i], 0, sizeof gd->linedata[i]);
+			memset(grid_get_line(gd, i), 0, sizeof *gd->linedata);
 	}
 
 	/* Set the new size, and reset the scroll region. */
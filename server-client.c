@@ -30,8 +30,12 @@
 void	server_client_check_mouse(struct client *, struct window_pane *,
 	    struct mouse_event *);
 void	server_client_repeat_timer(int, short, void *);
+void	server_client_frame_timer(int, short, void *);
 void	server_client_check_exit(struct client *);
 void	server_client_check_redraw(struct client *);
+void	server_client_redraw_panes(struct window *);
+int	server_client_check_frame(struct client *);
+int	server_client_frame_wait(struct client *);
 void	server_client_set_title(struct client *);
 void	server_client_reset_state(struct client *);
 
@@ -90,6 +94,7 @@ server_client_create(int fd)
 	c->last_mouse.x = c->last_mouse.y = -1;
 
 	evtimer_set(&c->repeat_timer, server_client_repeat_timer, c);
+	evtimer_set(&c->frame_timer, server_client_frame_timer, c);
 
 	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
 		if (ARRAY_ITEM(&clients, i) == NULL) {
@@ -154,6 +159,7 @@ server_client_lost(struct client *c)
 	free(c->title);
 
 	evtimer_del(&c->repeat_timer);
+	evtimer_del(&c->frame_timer);
 
 	if (event_initialized(&c->identify_timer))
 		evtimer_del(&c->identify_timer);
@@ -459,18 +465,34 @@ server_client_loop(void)
 	struct window_pane	*wp;
 	u_int		 	 i;
 
+	for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
+		w = ARRAY_ITEM(&windows, i);
+		if (w != NULL && !ARRAY_EMPTY(&w->clients))
+			server_client_redraw_panes(w);
+	}
+
 	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
 		c = ARRAY_ITEM(&clients, i);
 		if (c == NULL)
 			continue;
 
 		server_client_check_exit(c);
-		if (c->session != NULL) {
+		if (c->session != NULL && !tty_block_maybe(&c->tty)) {
 			server_client_check_redraw(c);
 			server_client_reset_state(c);
 		}
 	}
 
+	/*
+	 * Send everything written this time round in one go. This is left
+	 * until all clients are done so output can be copied between them.
+	 */
+	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
+		c = ARRAY_ITEM(&clients, i);
+		if (c != NULL)
+			tty_flush(&c->tty);
+	}
+
 	/*
 	 * Any windows will have been redrawn as part of clients, so clear
 	 * their flags now.
@@ -480,9 +502,85 @@ server_client_loop(void)
 		if (w == NULL)
 			continue;
 
+		TAILQ_FOREACH(wp, &w->panes, entry) {
+			if (w->flags & WINDOW_REDRAW ||
+			    wp->flags & (PANE_REDRAW|PANE_CHANGED))
+				screen_clear_dirty(wp->screen);
+			wp->flags &= ~(PANE_REDRAW|PANE_CHANGED);
+			wp->scrolled = 0;
+		}
 		w->flags &= ~WINDOW_REDRAW;
-		TAILQ_FOREACH(wp, &w->panes, entry)
-			wp->flags &= ~PANE_REDRAW;
+	}
+}
+
+/*
+ * Redraw panes which have changed for every client viewing the window. This is
+ * done for all clients together so that those in the same state are given a
+ * copy of the output of the first rather than drawing again. Clients being
+ * redrawn in full or drawing frames are left to server_client_check_redraw.
+ */
+void
+server_client_redraw_panes(struct window *w)
+{
+	struct window_pane	*wp;
+	struct client		*c;
+	struct tty_share	 share;
+	u_int			 i, yoff;
+
+	TAILQ_FOREACH(wp, &w->panes, entry) {
+		if (!(wp->flags & (PANE_REDRAW|PANE_CHANGED)))
+			continue;
+
+		share.lead = NULL;
+		for (i = 0; i < ARRAY_LENGTH(&w->clients); i++) {
+			c = ARRAY_ITEM(&w->clients, i);
+			if (c->session == NULL || c->session->curw->window != w)
+				continue;
+			if (c->flags & (CLIENT_DEAD|CLIENT_SUSPENDED))
+				continue;
+			if (c->flags & (CLIENT_REDRAW|CLIENT_REDRAWWINDOW))
+				continue;
+			if (c->tty.flags & TTY_DIFF || tty_block_maybe(&c->tty))
+				continue;
+
+			yoff = wp->yoff;
+			if (status_at_line(c) == 0)
+				yoff++;
+			if (tty_share_start(&share, &c->tty, yoff))
+				continue;
+
+			if (wp->flags & PANE_REDRAW)
+				screen_redraw_pane(c, wp);
+			else
+				screen_redraw_changed(c, wp);
+			tty_share_end(&share, &c->tty);
+		}
+	}
+}
+
+/*
+ * Rebuild the list of clients viewing each window, used by tty_write. This is
+ * done each time round the server loop; a client which changes window in the
+ * meantime is redrawn in full at the end of the loop anyway.
+ */
+void
+server_client_update_windows(void)
+{
+	struct window	*w;
+	struct client	*c;
+	u_int		 i;
+
+	for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
+		w = ARRAY_ITEM(&windows, i);
+		if (w != NULL)
+			ARRAY_CLEAR(&w->clients);
+	}
+
+	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
+		c = ARRAY_ITEM(&clients, i);
+		if (c == NULL || c->session == NULL || c->session->curw == NULL)
+			continue;
+		ARRAY_ADD(&c->session->curw->window->clients, c);
 	}
 }
 
@@ -492,8 +590,8 @@ server_client_loop(void)
  * a user may interrupt tmux, for example with ~^Z in ssh(1). This is a
  * compromise between excessive resets and likelihood of an interrupt.
  *
- * tty_region/tty_reset/tty_update_mode already take care of not resetting
- * things that are already in their default state.
+ * tty_region/tty_margin_off/tty_reset/tty_update_mode already take care of
+ * not resetting things that are already in their default state.
  */
 void
 server_client_reset_state(struct client *c)
@@ -508,7 +606,12 @@ server_client_reset_state(struct client *c)
 	if (c->flags & CLIENT_SUSPENDED)
 		return;
 
+	/* Leave the cursor where it is until the waiting frame is drawn. */
+	if (c->flags & CLIENT_FRAME)
+		return;
+
 	tty_region(&c->tty, 0, c->tty.sy - 1);
+	tty_margin_off(&c->tty);
 
 	status = options_get_number(oo, "status");
 	if (!window_pane_visible(wp) || wp->yoff + s->cy >= c->tty.sy - status)
@@ -572,6 +675,16 @@ server_client_repeat_timer(unused int fd, unused short events, void *data)
 		c->flags &= ~(CLIENT_PREFIX|CLIENT_REPEAT);
 }
 
+/*
+ * Frame time callback. Nothing to do: any frame held back is drawn by
+ * server_client_loop now the timer is no longer pending.
+ */
+/* ARGSUSED */
+void
+server_client_frame_timer(unused int fd, unused short events, unused void *data)
+{
+}
+
 /* Check if client should be exited. */
 void
 server_client_check_exit(struct client *c)
@@ -608,6 +721,14 @@ server_client_check_redraw(struct client *c)
 	flags = c->tty.flags & TTY_FREEZE;
 	c->tty.flags &= ~TTY_FREEZE;
 
+	/*
+	 * Changing render-mode or max-fps redraws the client, so it can be
+	 * picked up here without losing anything.
+	 */
+	tty_set_render(&c->tty,
+	    options_get_number(&s->options, "render-mode") ||
+	    options_get_number(&s->options, "max-fps") != 0);
+
 	if (c->flags & (CLIENT_REDRAW|CLIENT_STATUS)) {
 		if (options_get_number(&s->options, "set-titles"))
 			server_client_set_title(c);
@@ -622,31 +743,84 @@ server_client_check_redraw(struct client *c)
 			c->flags &= ~CLIENT_STATUS;
 	}
 
-	if (c->flags & CLIENT_REDRAW) {
+	if (c->tty.flags & TTY_DIFF) {
+		if (c->flags & CLIENT_REDRAW)
+			tty_frame_invalidate(&c->tty);
+		if (server_client_check_frame(c)) {
+			if (server_client_frame_wait(c))
+				c->flags |= CLIENT_FRAME;
+			else {
+				screen_redraw_frame(c);
+				c->flags &= ~CLIENT_FRAME;
+			}
+		}
+		c->flags &= ~CLIENT_REDRAWWINDOW;
+	} else if (c->flags & CLIENT_REDRAW) {
 		screen_redraw_screen(c, 0, 0);
 		c->flags &= ~(CLIENT_STATUS|CLIENT_BORDERS);
 	} else if (c->flags & CLIENT_REDRAWWINDOW) {
 		TAILQ_FOREACH(wp, &c->session->curw->window->panes, entry)
 			screen_redraw_pane(c, wp);
 		c->flags &= ~CLIENT_REDRAWWINDOW;
-	} else {
-		TAILQ_FOREACH(wp, &c->session->curw->window->panes, entry) {
-			if (wp->flags & PANE_REDRAW)
-				screen_redraw_pane(c, wp);
-		}
 	}
 
-	if (c->flags & CLIENT_BORDERS)
-		screen_redraw_screen(c, 0, 1);
+	if (!(c->tty.flags & TTY_DIFF)) {
+		if (c->flags & CLIENT_BORDERS)
+			screen_redraw_screen(c, 0, 1);
+		if (c->flags & CLIENT_STATUS)
+			screen_redraw_screen(c, 1, 0);
 
-	if (c->flags & CLIENT_STATUS)
-		screen_redraw_screen(c, 1, 0);
+		/* A frame held back before leaving diff mode is not needed. */
+		c->flags &= ~CLIENT_FRAME;
+	}
 
 	c->tty.flags |= flags;
 
 	c->flags &= ~(CLIENT_REDRAW|CLIENT_STATUS|CLIENT_BORDERS);
 }
 
+/* Check if a client drawing with render-mode diff needs a new frame. */
+int
+server_client_check_frame(struct client *c)
+{
+	struct window_pane	*wp;
+	int			 flags;
+
+	flags = CLIENT_REDRAW|CLIENT_REDRAWWINDOW|CLIENT_BORDERS|
+	    CLIENT_STATUS|CLIENT_FRAME;
+	if (c->flags & flags)
+		return (1);
+	if (c->session->curw->window->flags & WINDOW_REDRAW)
+		return (1);
+	TAILQ_FOREACH(wp, &c->session->curw->window->panes, entry) {
+		if (wp->flags & (PANE_REDRAW|PANE_CHANGED))
+			return (1);
+	}
+	return (0);
+}
+
+/*
+ * Check if a frame must be held back to keep within max-fps. Each frame drawn
+ * starts the timer and no more are drawn until it has expired.
+ */
+int
+server_client_frame_wait(struct client *c)
+{
+	struct timeval	tv;
+	int		fps;
+
+	if (evtimer_pending(&c->frame_timer, NULL))
+		return (1);
+
+	fps = options_get_number(&c->session->options, "max-fps");
+	if (fps != 0) {
+		tv.tv_sec = 0;
+		tv.tv_usec = 1000000L / fps;
+		evtimer_add(&c->frame_timer, &tv);
+	}
+	return (0);
+}
+
 /* Set client title. */
 void
 server_client_set_title(struct client *c)
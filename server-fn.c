@@ -162,9 +162,13 @@ server_redraw_window(struct window *w)
 	struct client	*c;
 	u_int		 i;
 
-	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
-		c = ARRAY_ITEM(&clients, i);
-		if (c == NULL || c->session == NULL)
+	/*
+	 * Clients which have changed to this window since the list was built
+	 * are already being redrawn in full.
+	 */
+	for (i = 0; i < ARRAY_LENGTH(&w->clients); i++) {
+		c = ARRAY_ITEM(&w->clients, i);
+		if (c->session == NULL)
 			continue;
 		if (c->session->curw->window == w)
 			server_redraw_client(c);
@@ -178,9 +182,9 @@ server_redraw_window_borders(struct window *w)
 	struct client	*c;
 	u_int		 i;
 
-	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
-		c = ARRAY_ITEM(&clients, i);
-		if (c == NULL || c->session == NULL)
+	for (i = 0; i < ARRAY_LENGTH(&w->clients); i++) {
+		c = ARRAY_ITEM(&w->clients, i);
+		if (c->session == NULL)
 			continue;
 		if (c->session->curw->window == w)
 			c->flags |= CLIENT_BORDERS;
@@ -190,7 +194,7 @@ server_redraw_window_borders(struct window *w)
 void
 server_status_window(struct window *w)
 {
-	struct session	*s;
+	struct winlink	*wl;
 
 	/*
 	 * This is slightly different. We want to redraw the status line of any
@@ -198,10 +202,8 @@ server_status_window(struct window *w)
 	 * current window.
 	 */
 
-	RB_FOREACH(s, sessions, &sessions) {
-		if (session_has(s, w) != NULL)
-			server_status_session(s);
-	}
+	TAILQ_FOREACH(wl, &w->winlinks, wentry)
+		server_status_session(wl->session);
 }
 
 void
@@ -259,27 +261,26 @@ server_lock_client(struct client *c)
 void
 server_kill_window(struct window *w)
 {
-	struct session	*s, *next_s;
+	struct session	*s;
 	struct winlink	*wl;
 
-	next_s = RB_MIN(sessions, &sessions);
-	while (next_s != NULL) {
-		s = next_s;
-		next_s = RB_NEXT(sessions, &sessions, s);
-
-		if (session_has(s, w) == NULL)
+	/*
+	 * Hold a reference so the window is not destroyed until it has been
+	 * removed from every session.
+	 */
+	w->references++;
+	while ((wl = TAILQ_FIRST(&w->winlinks)) != NULL) {
+		s = wl->session;
+		if (session_detach(s, wl)) {
+			server_destroy_session_group(s);
 			continue;
-		while ((wl = winlink_find_by_window(&s->windows, w)) != NULL) {
-			if (session_detach(s, wl)) {
-				server_destroy_session_group(s);
-				break;
-			} else
-				server_redraw_session_group(s);
 		}
+		server_redraw_session_group(s);
 
 		if (options_get_number(&s->options, "renumber-windows"))
 			session_renumber_windows(s);
 	}
+	window_remove_ref(w);
 }
 
 int
@@ -17,6 +17,7 @@
  */
 
 #include <sys/types.h>
+#include <sys/time.h>
 
 #include <event.h>
 #include <stdlib.h>
@@ -29,9 +30,128 @@ int	server_window_check_activity(struct session *, struct winlink *);
 int	server_window_check_silence(struct session *, struct winlink *);
 int	server_window_check_content(
 	    struct session *, struct winlink *, struct window_pane *);
+int	server_window_silence_left(struct window *, struct timeval *);
+void	server_window_start_silence(struct window *);
+void	server_window_silence_callback(int, short, void *);
 void	ring_bell(struct session *);
 
-/* Window functions that need to happen every loop. */
+/* Windows with alerts raised since the last loop. */
+TAILQ_HEAD(, window) server_window_alerts =
+    TAILQ_HEAD_INITIALIZER(server_window_alerts);
+
+/*
+ * Raise alerts on a window. They are checked against each session containing
+ * the window at the end of the loop, so windows with nothing happening are not
+ * looked at.
+ */
+void
+server_window_alert(struct window *w, int flags)
+{
+	w->flags |= flags;
+	if (!(w->flags & WINDOW_ALERTQUEUED)) {
+		TAILQ_INSERT_TAIL(&server_window_alerts, w, alerts_entry);
+		w->flags |= WINDOW_ALERTQUEUED;
+	}
+}
+
+/* Remove a window which is being destroyed from the alerts list. */
+void
+server_window_unqueue(struct window *w)
+{
+	if (w->flags & WINDOW_ALERTQUEUED) {
+		TAILQ_REMOVE(&server_window_alerts, w, alerts_entry);
+		w->flags &= ~WINDOW_ALERTQUEUED;
+	}
+	if (event_initialized(&w->silence_timer))
+		evtimer_del(&w->silence_timer);
+}
+
+/*
+ * Work out how long is left until a window has had no output for its
+ * monitor-silence interval. Returns -1 if silence is not monitored, 0 if the
+ * interval has already passed and 1 otherwise.
+ */
+int
+server_window_silence_left(struct window *w, struct timeval *tv)
+{
+	struct timeval	now;
+	int		interval;
+
+	interval = options_get_number(&w->options, "monitor-silence");
+	if (interval == 0)
+		return (-1);
+
+	if (gettimeofday(&now, NULL) != 0)
+		fatal("gettimeofday failed");
+	tv->tv_sec = interval;
+	tv->tv_usec = 0;
+	timeradd(&w->silence_time, tv, tv);
+	if (!timercmp(tv, &now, >)) {
+		timerclear(tv);
+		return (0);
+	}
+	timersub(tv, &now, tv);
+	return (1);
+}
+
+/* Start the silence timer for the time left, if silence is monitored. */
+void
+server_window_start_silence(struct window *w)
+{
+	struct timeval	tv;
+
+	if (event_initialized(&w->silence_timer))
+		evtimer_del(&w->silence_timer);
+	if (server_window_silence_left(w, &tv) == -1)
+		return;
+
+	evtimer_set(&w->silence_timer, server_window_silence_callback, w);
+	evtimer_add(&w->silence_timer, &tv);
+}
+
+/* Start timing silence again from now, when options change or on focus. */
+void
+server_window_reset_silence(struct window *w)
+{
+	if (gettimeofday(&w->silence_time, NULL) != 0)
+		fatal("gettimeofday failed");
+	server_window_start_silence(w);
+}
+
+/*
+ * Output has stopped for now. This happens after every read, so only note the
+ * time unless the timer is not running; when it fires it is moved on to the
+ * end of the silence.
+ */
+void
+server_window_output(struct window *w)
+{
+	if (gettimeofday(&w->silence_time, NULL) != 0)
+		fatal("gettimeofday failed");
+	if (!event_initialized(&w->silence_timer) ||
+	    !evtimer_pending(&w->silence_timer, NULL))
+		server_window_start_silence(w);
+}
+
+/* Silence timer fired. Raise an alert unless there has been output since. */
+/* ARGSUSED */
+void
+server_window_silence_callback(unused int fd, unused short events, void *data)
+{
+	struct window	*w = data;
+	struct timeval	 tv;
+
+	switch (server_window_silence_left(w, &tv)) {
+	case 0:
+		server_window_alert(w, WINDOW_SILENCE);
+		break;
+	case 1:
+		evtimer_add(&w->silence_timer, &tv);
+		break;
+	}
+}
+
+/* Check windows which have raised alerts. */
 void
 server_window_loop(void)
 {
@@ -39,16 +159,15 @@ server_window_loop(void)
 	struct winlink		*wl;
 	struct window_pane	*wp;
 	struct session		*s;
-	u_int		 	 i;
 
-	for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
-		w = ARRAY_ITEM(&windows, i);
-		if (w == NULL)
-			continue;
+	while ((w = TAILQ_FIRST(&server_window_alerts)) != NULL) {
+		TAILQ_REMOVE(&server_window_alerts, w, alerts_entry);
+		w->flags &= ~WINDOW_ALERTQUEUED;
 
-		RB_FOREACH(s, sessions, &sessions) {
-			wl = session_has(s, w);
-			if (wl == NULL)
+		TAILQ_FOREACH(wl, &w->winlinks, wentry) {
+			/* Only check the first link in each session. */
+			s = wl->session;
+			if (session_has(s, w) != wl)
 				continue;
 
 			if (server_window_check_bell(s, wl) ||
@@ -58,6 +177,11 @@ server_window_loop(void)
 			TAILQ_FOREACH(wp, &w->panes, entry)
 				server_window_check_content(s, wl, wp);
 		}
+
+		/* Content is only looked for in output since the last loop. */
+		TAILQ_FOREACH(wp, &w->panes, entry)
+			screen_clear_unsearched(&wp->base);
+		w->flags &= ~WINDOW_ALERTFLAGS;
 	}
 }
 
@@ -76,8 +200,6 @@ server_window_check_bell(struct session *s, struct winlink *wl)
 		wl->flags |= WINLINK_BELL;
 	if (s->flags & SESSION_UNATTACHED)
 		return (1);
-	if (s->curw->window == wl->window)
-		w->flags &= ~WINDOW_BELL;
 
 	visual = options_get_number(&s->options, "visual-bell");
 	action = options_get_number(&s->options, "bell-action");
@@ -108,9 +230,6 @@ server_window_check_activity(struct session *s, struct winlink *wl)
 	struct window	*w = wl->window;
 	u_int		 i;
 
-	if (s->curw->window == wl->window)
-		w->flags &= ~WINDOW_ACTIVITY;
-
 	if (!(w->flags & WINDOW_ACTIVITY) || wl->flags & WINLINK_ACTIVITY)
 		return (0);
 	if (s->curw == wl && !(s->flags & SESSION_UNATTACHED))
@@ -142,35 +261,20 @@ server_window_check_silence(struct session *s, struct winlink *wl)
 {
 	struct client	*c;
 	struct window	*w = wl->window;
-	struct timeval	 timer;
 	u_int		 i;
-	int		 silence_interval, timer_difference;
 
 	if (!(w->flags & WINDOW_SILENCE) || wl->flags & WINLINK_SILENCE)
 		return (0);
 
 	if (s->curw == wl && !(s->flags & SESSION_UNATTACHED)) {
 		/*
-		 * Reset the timer for this window if we've focused it.  We
-		 * don't want the timer tripping as soon as we've switched away
-		 * from this window.
+		 * Start the timer again if the window is focused. We don't want
+		 * it tripping as soon as we've switched away from this window.
 		 */
-		if (gettimeofday(&w->silence_timer, NULL) != 0)
-			fatal("gettimeofday failed.");
-
+		server_window_reset_silence(w);
 		return (0);
 	}
 
-	silence_interval = options_get_number(&w->options, "monitor-silence");
-	if (silence_interval == 0)
-		return (0);
-
-	if (gettimeofday(&timer, NULL) != 0)
-		fatal("gettimeofday");
-	timer_difference = timer.tv_sec - w->silence_timer.tv_sec;
-	if (timer_difference <= silence_interval)
-		return (0);
-
 	if (options_get_number(&s->options, "bell-on-alert"))
 		ring_bell(s);
 	wl->flags |= WINLINK_SILENCE;
@@ -196,12 +300,9 @@ server_window_check_content(
 	struct client	*c;
 	struct window	*w = wl->window;
 	u_int		 i;
-	char		*found, *ptr;
+	char		*ptr;
 
 	/* Activity flag must be set for new content. */
-	if (s->curw->window == w)
-		w->flags &= ~WINDOW_ACTIVITY;
-
 	if (!(w->flags & WINDOW_ACTIVITY) || wl->flags & WINLINK_CONTENT)
 		return (0);
 	if (s->curw == wl && !(s->flags & SESSION_UNATTACHED))
@@ -210,9 +311,8 @@ server_window_check_content(
 	ptr = options_get_string(&w->options, "monitor-content");
 	if (ptr == NULL || *ptr == '\0')
 		return (0);
-	if ((found = window_pane_search(wp, ptr, NULL)) == NULL)
+	if (!window_pane_search_changed(wp, ptr))
 		return (0);
-	free(found);
 
 	if (options_get_number(&s->options, "bell-on-alert"))
 		ring_bell(s);
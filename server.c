@@ -142,7 +142,9 @@ server_start(int lockfd, char *lockfile)
 	log_debug("server started, pid %ld", (long) getpid());
 
 	ARRAY_INIT(&windows);
+	RB_INIT(&all_windows);
 	RB_INIT(&all_window_panes);
+	RB_INIT(&all_window_pane_pids);
 	ARRAY_INIT(&clients);
 	ARRAY_INIT(&dead_clients);
 	RB_INIT(&sessions);
@@ -209,6 +211,7 @@ void
 server_loop(void)
 {
 	while (!server_should_shutdown()) {
+		server_client_update_windows();
 		event_loop(EVLOOP_ONCE);
 
 		server_window_loop();
@@ -430,50 +433,28 @@ server_child_signal(void)
 void
 server_child_exited(pid_t pid, int status)
 {
-	struct window		*w;
 	struct window_pane	*wp;
 	struct job		*job;
-	u_int		 	 i;
 
-	for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
-		if ((w = ARRAY_ITEM(&windows, i)) == NULL)
-			continue;
-		TAILQ_FOREACH(wp, &w->panes, entry) {
-			if (wp->pid == pid) {
-				server_destroy_pane(wp);
-				break;
-			}
-		}
+	if ((wp = window_pane_find_by_pid(pid)) != NULL) {
+		window_pane_remove_pid(wp);
+		server_destroy_pane(wp);
 	}
 
-	LIST_FOREACH(job, &all_jobs, lentry) {
-		if (pid == job->pid) {
-			job_died(job, status);	/* might free job */
-			break;
-		}
-	}
+	if ((job = job_find_by_pid(pid)) != NULL)
+		job_died(job, status);	/* might free job */
 }
 
 /* Handle stopped children. */
 void
 server_child_stopped(pid_t pid, int status)
 {
-	struct window		*w;
-	struct window_pane	*wp;
-	u_int			 i;
-
 	if (WSTOPSIG(status) == SIGTTIN || WSTOPSIG(status) == SIGTTOU)
 		return;
 
-	for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
-		if ((w = ARRAY_ITEM(&windows, i)) == NULL)
-			continue;
-		TAILQ_FOREACH(wp, &w->panes, entry) {
-			if (wp->pid == pid) {
-				if (killpg(pid, SIGCONT) != 0)
-					kill(pid, SIGCONT);
-			}
-		}
+	if (window_pane_find_by_pid(pid) != NULL) {
+		if (killpg(pid, SIGCONT) != 0)
+			kill(pid, SIGCONT);
 	}
 }
 
@@ -482,26 +463,14 @@ server_child_stopped(pid_t pid, int status)
 void
 server_second_callback(unused int fd, unused short events, unused void *arg)
 {
-	struct window		*w;
-	struct window_pane	*wp;
 	struct timeval		 tv;
-	u_int		 	 i;
 
 	if (options_get_number(&global_s_options, "lock-server"))
 		server_lock_server();
 	else
 		server_lock_sessions();
 
-	for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
-		w = ARRAY_ITEM(&windows, i);
-		if (w == NULL)
-			continue;
-
-		TAILQ_FOREACH(wp, &w->panes, entry) {
-			if (wp->mode != NULL && wp->mode->timer != NULL)
-				wp->mode->timer(wp);
-		}
-	}
+	window_pane_mode_timers();
 
 	server_client_status_timer();
 
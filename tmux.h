@@ -55,6 +55,9 @@ extern char   **environ;
 /* Automatic name refresh interval, in milliseconds. */
 #define NAME_INTERVAL 500
 
+/* Maximum number of windows to check for automatic rename each interval. */
+#define NAME_BUDGET 250
+
 /*
  * Maximum sizes of strings in message data. Don't forget to bump
  * PROTOCOL_VERSION if any of these change!
@@ -242,6 +245,7 @@ enum key_code {
 enum tty_code_code {
 	TTYC_AX = 0,
 	TTYC_ACSC,	/* acs_chars, ac */
+	TTYC_BCE,	/* back_color_erase, ut */
 	TTYC_BEL,	/* bell, bl */
 	TTYC_BLINK,	/* enter_blink_mode, mb */
 	TTYC_BOLD,	/* enter_bold_mode, md */
@@ -268,10 +272,13 @@ enum tty_code_code {
 	TTYC_DIM,	/* enter_dim_mode, mh */
 	TTYC_DL,	/* parm_delete_line, DL */
 	TTYC_DL1,	/* delete_line, dl */
+	TTYC_DSMG,	/* disable left and right margins, Dsmg */
 	TTYC_E3,
+	TTYC_ECH,	/* erase_chars, ec */
 	TTYC_EL,	/* clr_eol, ce */
 	TTYC_EL1,	/* clr_bol, cb */
 	TTYC_ENACS,	/* ena_acs, eA */
+	TTYC_ENMG,	/* enable left and right margins, Enmg */
 	TTYC_FSL,	/* from_status_line, fsl */
 	TTYC_HOME,	/* cursor_home, ho */
 	TTYC_HPA,	/* column_address, ch */
@@ -377,6 +384,7 @@ enum tty_code_code {
 	TTYC_KUP7,
 	TTYC_MS,	/* modify xterm(1) selection */
 	TTYC_OP,	/* orig_pair, op */
+	TTYC_REP,	/* repeat_char, rp */
 	TTYC_REV,	/* enter_reverse_mode, mr */
 	TTYC_RI,	/* scroll_reverse, sr */
 	TTYC_RMACS,	/* exit_alt_charset_mode */
@@ -388,9 +396,11 @@ enum tty_code_code {
 	TTYC_SITM,	/* enter_italics_mode, it */
 	TTYC_SMACS,	/* enter_alt_charset_mode, as */
 	TTYC_SMCUP,	/* enter_ca_mode, ti */
+	TTYC_SMGLR,	/* set left and right margins, Smglr */
 	TTYC_SMKX,	/* keypad_xmit, ks */
 	TTYC_SMSO,	/* enter_standout_mode, so */
 	TTYC_SMUL,	/* enter_underline_mode, us */
+	TTYC_SYNC,	/* start or end synchronized update, Sync */
 	TTYC_TSL,	/* to_status_line, tsl */
 	TTYC_VPA,	/* row_address, cv */
 	TTYC_XENL,	/* eat_newline_glitch, xn */
@@ -416,6 +426,18 @@ struct tty_code {
 	} value;
 };
 
+/*
+ * Termcap code with arguments, compiled into the text around each argument so
+ * it can be expanded without tparm.
+ */
+#define TTY_TERM_FMT_ARGS 4
+struct tty_term_fmt {
+	u_int		 n;			/* arguments written */
+	u_int		 arg[TTY_TERM_FMT_ARGS];	/* parameter of each */
+	int		 incr;			/* add one to parameters */
+	char		*text[TTY_TERM_FMT_ARGS + 1];
+};
+
 /* Entry in terminal code table. */
 struct tty_term_code_entry {
 	enum tty_code_code	code;
@@ -658,13 +680,7 @@ struct mode_key_table {
 
 #define ALL_MOUSE_MODES (MODE_MOUSE_STANDARD|MODE_MOUSE_BUTTON|MODE_MOUSE_ANY)
 
-/*
- * A single UTF-8 character.
- *
- * The data member in this must be UTF8_SIZE to allow screen_write_copy to
- * reinject stored UTF-8 data back into screen_write_cell after combining (ugh
- * XXX XXX).
- */
+/* A single UTF-8 character. */
 struct utf8_data {
 	u_char	data[UTF8_SIZE];
 
@@ -699,20 +715,35 @@ struct utf8_data {
 #define GRID_FLAG_BG256 0x2
 #define GRID_FLAG_PADDING 0x4
 #define GRID_FLAG_UTF8 0x8
+#define GRID_FLAG_WIDE 0x10
 
 /* Grid line flags. */
 #define GRID_LINE_WRAPPED 0x1
+#define GRID_LINE_PACKED 0x2
+#define GRID_LINE_COMPRESSED 0x4
 
-/* Grid cell data. */
+/*
+ * First cell data value which is an index into the UTF-8 table, after the last
+ * Unicode code point.
+ */
+#define GRID_UTF8_TABLE 0x110000
+
+/*
+ * Grid cell data. For UTF-8 cells, data is either the Unicode code point or
+ * GRID_UTF8_TABLE plus an index into the UTF-8 table (see grid-utf8.c).
+ */
 struct grid_cell {
 	u_char	attr;
 	u_char	flags;
 	u_char	fg;
 	u_char	bg;
-	u_char	data;
+	u_int	data;
 } __packed;
 
-/* Grid cell UTF-8 data. Used instead of data in grid_cell for UTF-8 cells. */
+/* Width of a grid cell. */
+#define grid_cell_width(gc) (((gc)->flags & GRID_FLAG_WIDE) ? 2 : 1)
+
+/* Grid cell UTF-8 data, as stored in the UTF-8 table. */
 struct grid_utf8 {
 	u_char	width;
 	u_char	data[UTF8_SIZE];
@@ -723,8 +754,7 @@ struct grid_line {
 	u_int	cellsize;
 	struct grid_cell *celldata;
 
-	u_int	utf8size;
-	struct grid_utf8 *utf8data;
+	u_char	*packed;	/* if GRID_LINE_PACKED */
 
 	int	flags;
 } __packed;
@@ -740,8 +770,18 @@ struct grid {
 	u_int	hsize;
 	u_int	hlimit;
 
-	struct grid_line *linedata;
+	u_int	hhot;		/* history lines kept uncompressed */
+	u_int	hthawed;	/* lines unpacked since last packed */
+	size_t	hcompressed;	/* bytes of compressed lines */
+	size_t	huncompressed;	/* bytes of those lines uncompressed */
+
+	struct grid_line *linedata;	/* circular, linesize entries */
+	u_int	linesize;
+	u_int	lineoff;		/* index of line 0 */
+
+	TAILQ_ENTRY(grid) entry;
 };
+TAILQ_HEAD(grids, grid);
 
 /* Option data structures. */
 struct options_entry {
@@ -778,8 +818,10 @@ struct job {
 	void		*data;
 
 	LIST_ENTRY(job)	 lentry;
+	RB_ENTRY(job)	 pid_entry;
 };
 LIST_HEAD(joblist, job);
+RB_HEAD(job_pid_tree, job);
 
 /* Screen selection. */
 struct screen_sel {
@@ -813,6 +855,9 @@ struct screen {
 	int		 mode;
 
 	bitstr_t	*tabs;
+	bitstr_t	*dirty;		/* lines changed but not drawn */
+	bitstr_t	*unsearched;	/* lines changed but not searched */
+	u_int		 unsearched_top;
 
 	struct screen_sel sel;
 };
@@ -918,6 +963,9 @@ struct window_pane {
 	int		 flags;
 #define PANE_REDRAW 0x1
 #define PANE_DROP 0x2
+#define PANE_CHANGED 0x4
+#define PANE_CHANGESQUEUED 0x8
+#define PANE_MODETIMER 0x10
 
 	char		*cmd;
 	char		*shell;
@@ -927,8 +975,13 @@ struct window_pane {
 	char		 tty[TTY_NAME_MAX];
 
 	u_int		 changes;
-	struct event	 changes_timer;
 	u_int		 changes_redraw;
+	TAILQ_ENTRY(window_pane) changes_entry;
+
+	/* Entry on list of panes in a mode with a timer. */
+	TAILQ_ENTRY(window_pane) timer_entry;
+
+	u_int		 scrolled;	/* lines scrolled this loop */
 
 	int		 fd;
 	struct bufferevent *event;
@@ -953,9 +1006,11 @@ struct window_pane {
 
 	TAILQ_ENTRY(window_pane) entry;
 	RB_ENTRY(window_pane) tree_entry;
+	RB_ENTRY(window_pane) pid_entry;
 };
 TAILQ_HEAD(window_panes, window_pane);
 RB_HEAD(window_pane_tree, window_pane);
+RB_HEAD(window_pane_pid_tree, window_pane);
 
 /* Window last layout. */
 struct last_layout {
@@ -968,8 +1023,15 @@ struct last_layout {
 struct window {
 	u_int		 id;
 	char		*name;
-	struct event	 name_timer;
-	struct timeval   silence_timer;
+	struct event	 silence_timer;
+	struct timeval	 silence_time;
+
+	/*
+	 * Active pane ID and its process group when the name was last found.
+	 * The ID is UINT_MAX if the name must be found again.
+	 */
+	u_int		 name_pane;
+	pid_t		 name_pgrp;
 
 	struct window_pane *active;
 	struct window_pane *last;
@@ -984,21 +1046,44 @@ struct window {
 	u_int		 sx;
 	u_int		 sy;
 
+	/* Border and owning pane of each cell, built when first needed. */
+	u_char		*map;
+	struct window_pane **map_panes;
+#define WINDOW_MAP_OUTSIDE 0
+#define WINDOW_MAP_INSIDE 1
+#define WINDOW_MAP_BORDER 2
+
 	int		 flags;
 #define WINDOW_BELL 0x1
 #define WINDOW_ACTIVITY 0x2
 #define WINDOW_REDRAW 0x4
 #define WINDOW_SILENCE 0x8
+#define WINDOW_ALERTFLAGS (WINDOW_BELL|WINDOW_ACTIVITY|WINDOW_SILENCE)
+#define WINDOW_ALERTQUEUED 0x10
+#define WINDOW_NAMEOUTPUT 0x20
 
 	struct options	 options;
 
+	/* Clients with this as their current window. */
+	ARRAY_DECL(, struct client *) clients;
+
+	/* Winlinks in any session which point to this window. */
+	TAILQ_HEAD(, winlink) winlinks;
+
+	/* Entry on list of windows with alerts to check. */
+	TAILQ_ENTRY(window) alerts_entry;
+
 	u_int		 references;
+
+	RB_ENTRY(window) tree_entry;
 };
 ARRAY_DECL(windows, struct window *);
+RB_HEAD(window_tree, window);
 
 /* Entry on local window list. */
 struct winlink {
 	int		 idx;
+	struct session	*session;
 	struct window	*window;
 
 	size_t		 status_width;
@@ -1015,6 +1100,7 @@ struct winlink {
 
 	RB_ENTRY(winlink) entry;
 	TAILQ_ENTRY(winlink) sentry;
+	TAILQ_ENTRY(winlink) wentry;
 };
 RB_HEAD(winlinks, winlink);
 TAILQ_HEAD(winlink_stack, winlink);
@@ -1145,10 +1231,15 @@ struct tty_term {
 	char		 acs[UCHAR_MAX + 1][2];
 
 	struct tty_code	 codes[NTTYCODE];
+	u_int		 costs[NTTYCODE];	/* length less arguments */
+	struct tty_term_fmt *fmts[NTTYCODE];
+	char		*colours[2][256];	/* setaf and setab expanded */
+	u_char		 sgr[7];	/* SGR parameter of each attribute */
 
 #define TERM_256COLOURS 0x1
 #define TERM_88COLOURS 0x2
 #define TERM_EARLYWRAP 0x4
+#define TERM_SGR 0x8
 	int		 flags;
 
 	LIST_ENTRY(tty_term) entry;
@@ -1173,12 +1264,17 @@ struct tty {
 
 	u_int		 rlower;
 	u_int		 rupper;
+	u_int		 rleft;
+	u_int		 rright;
 
 	char		*termname;
 	struct tty_term	*term;
 
 	int		 fd;
 	struct bufferevent *event;
+	char		*out;		/* output since the last flush */
+	size_t		 outlen;
+	u_int		 outpassed;	/* times passed on before a flush */
 
 	int		 log_fd;
 
@@ -1186,12 +1282,23 @@ struct tty {
 
 	struct grid_cell cell;
 
+	/* Screen to show and what the terminal shows, for render-mode diff. */
+	struct grid_cell *frame;
+	struct grid_cell *shadow;
+
+	u_int		 dropped;	/* updates not sent while blocked */
+	u_int		 redraws;	/* redraws after being blocked */
+	u_int		 frames;	/* synchronized updates sent */
+
 #define TTY_NOCURSOR 0x1
 #define TTY_FREEZE 0x2
 #define TTY_ESCAPE 0x4
 #define TTY_UTF8 0x8
 #define TTY_STARTED 0x10
 #define TTY_OPENED 0x20
+#define TTY_DIFF 0x40
+#define TTY_BLOCK 0x80
+#define TTY_SYNC 0x100
 	int		 flags;
 
 	int		 term_flags;
@@ -1202,12 +1309,59 @@ struct tty {
 	struct tty_key	*key_tree;
 };
 
+/*
+ * Output waiting for a terminal before updates stop being sent to it, and
+ * when they start again, in proportion to the size of the screen.
+ */
+#define TTY_BLOCK_START(tty) (1 + ((tty)->sx * (tty)->sy) * 8)
+#define TTY_BLOCK_STOP(tty) (1 + ((tty)->sx * (tty)->sy) / 8)
+
+/*
+ * The parts of a terminal's state which decide the output of a command and
+ * the state it leaves the terminal in.
+ */
+struct tty_state {
+	struct tty_term	*term;
+	int		 term_flags;
+	int		 flags;
+
+	u_int		 sx;
+	u_int		 sy;
+	u_int		 cx;
+	u_int		 cy;
+
+	u_int		 rupper;
+	u_int		 rlower;
+	u_int		 rleft;
+	u_int		 rright;
+
+	int		 mode;
+	u_int		 cstyle;
+	const char	*ccolour;
+
+	struct grid_cell cell;
+};
+
+/*
+ * The last terminal to draw something and the state it was in first, so that
+ * other terminals in the same state can be given a copy of its output.
+ */
+struct tty_share {
+	struct tty	*lead;
+	struct tty_state before;
+	size_t		 start;
+	u_int		 passed;
+	u_int		 yoff;
+};
+
+/* Size of the buffer for output to a terminal between flushes. */
+#define TTY_OUTSIZE 32768
+
 /* TTY command context and function pointer. */
 struct tty_ctx {
 	struct window_pane *wp;
 
 	const struct grid_cell *cell;
-	const struct grid_utf8 *utf8;
 
 	u_int		 num;
 	void		*ptr;
@@ -1228,7 +1382,6 @@ struct tty_ctx {
 
 	/* Saved last cell on line. */
 	struct grid_cell last_cell;
-	struct grid_utf8 last_utf8;
 	u_int		 last_width;
 };
 
@@ -1271,6 +1424,7 @@ struct client {
 	struct evbuffer	*stderr_data;
 
 	struct event	 repeat_timer;
+	struct event	 frame_timer;
 
 	struct status_out_tree status_old;
 	struct status_out_tree status_new;
@@ -1291,6 +1445,7 @@ struct client {
 #define CLIENT_READONLY 0x800
 #define CLIENT_REDRAWWINDOW 0x1000
 #define CLIENT_CONTROL 0x2000
+#define CLIENT_FRAME 0x4000
 	int		 flags;
 
 	struct event	 identify_timer;
@@ -1565,8 +1720,11 @@ int	options_table_find(
 
 /* job.c */
 extern struct joblist all_jobs;
+int	job_pid_cmp(struct job *, struct job *);
+RB_PROTOTYPE(job_pid_tree, job, pid_entry, job_pid_cmp);
 struct job *job_run(
 	    const char *, void (*)(struct job *), void (*)(void *), void *);
+struct job *job_find_by_pid(pid_t);
 void	job_free(struct job *);
 void	job_died(struct job *, int);
 
@@ -1588,6 +1746,10 @@ void	tty_init_termios(int, struct termios *, struct bufferevent *);
 void	tty_raw(struct tty *, const char *);
 void	tty_attributes(struct tty *, const struct grid_cell *);
 void	tty_reset(struct tty *);
+void	tty_margin_pane(struct tty *, const struct tty_ctx *);
+void	tty_margin(struct tty *, u_int, u_int);
+u_int	tty_margin_cx(struct tty *, const struct tty_ctx *);
+void	tty_margin_off(struct tty *);
 void	tty_region_pane(struct tty *, const struct tty_ctx *, u_int, u_int);
 void	tty_region(struct tty *, u_int, u_int);
 void	tty_cursor_pane(struct tty *, const struct tty_ctx *, u_int, u_int);
@@ -1599,6 +1761,7 @@ void	tty_putcode_ptr1(struct tty *, enum tty_code_code, const void *);
 void	tty_putcode_ptr2(struct tty *, enum tty_code_code, const void *, const void *);
 void	tty_puts(struct tty *, const char *);
 void	tty_putc(struct tty *, u_char);
+void	tty_putn(struct tty *, const void *, size_t, u_int);
 void	tty_pututf8(struct tty *, const struct grid_utf8 *);
 void	tty_init(struct tty *, struct client *, int, char *);
 int	tty_resize(struct tty *);
@@ -1606,10 +1769,18 @@ int	tty_set_size(struct tty *, u_int, u_int);
 void	tty_start_tty(struct tty *);
 void	tty_set_version(struct tty *, u_int);
 void	tty_stop_tty(struct tty *);
+void	tty_flush(struct tty *);
+int	tty_block_maybe(struct tty *);
+int	tty_share_start(struct tty_share *, struct tty *, u_int);
+void	tty_share_end(struct tty_share *, struct tty *);
 void	tty_set_title(struct tty *, const char *);
 void	tty_update_mode(struct tty *, int, struct screen *);
 void	tty_force_cursor_colour(struct tty *, const char *);
 void	tty_draw_line(struct tty *, struct screen *, u_int, u_int, u_int);
+void	tty_set_render(struct tty *, int);
+struct grid_cell *tty_frame_start(struct tty *);
+void	tty_frame_invalidate(struct tty *);
+void	tty_draw_frame(struct tty *, struct screen *);
 int	tty_open(struct tty *, const char *, char **);
 void	tty_close(struct tty *);
 void	tty_free(struct tty *);
@@ -1617,6 +1788,7 @@ void	tty_write(
 	    void (*)(struct tty *, const struct tty_ctx *), struct tty_ctx *);
 void	tty_cmd_alignmenttest(struct tty *, const struct tty_ctx *);
 void	tty_cmd_cell(struct tty *, const struct tty_ctx *);
+void	tty_cmd_cells(struct tty *, const struct tty_ctx *);
 void	tty_cmd_clearendofline(struct tty *, const struct tty_ctx *);
 void	tty_cmd_clearendofscreen(struct tty *, const struct tty_ctx *);
 void	tty_cmd_clearline(struct tty *, const struct tty_ctx *);
@@ -1649,6 +1821,10 @@ const char	*tty_term_ptr1(
 		     struct tty_term *, enum tty_code_code, const void *);
 const char	*tty_term_ptr2(
 		     struct tty_term *, enum tty_code_code, const void *, const void *);
+u_int		 tty_term_cost(struct tty_term *, enum tty_code_code);
+u_int		 tty_term_cost1(struct tty_term *, enum tty_code_code, int);
+u_int		 tty_term_cost2(
+		     struct tty_term *, enum tty_code_code, int, int);
 int		 tty_term_number(struct tty_term *, enum tty_code_code);
 int		 tty_term_flag(struct tty_term *, enum tty_code_code);
 
@@ -1840,9 +2016,14 @@ void	 server_client_lost(struct client *);
 void	 server_client_callback(int, short, void *);
 void	 server_client_status_timer(void);
 void	 server_client_loop(void);
+void	 server_client_update_windows(void);
 
 /* server-window.c */
 void	 server_window_loop(void);
+void	 server_window_alert(struct window *, int);
+void	 server_window_unqueue(struct window *);
+void	 server_window_reset_silence(struct window *);
+void	 server_window_output(struct window *);
 
 /* server-fn.c */
 void	 server_fill_environ(struct session *, struct environ *);
@@ -1931,44 +2112,63 @@ int	 attributes_fromstring(const char *);
 /* grid.c */
 extern const struct grid_cell grid_default_cell;
 extern const struct grid_cell grid_marker_cell;
+extern struct grids all_grids;
 struct grid *grid_create(u_int, u_int, u_int);
 void	 grid_destroy(struct grid *);
 int	 grid_compare(struct grid *, struct grid *);
+struct grid_line *grid_get_line(struct grid *, u_int);
+const struct grid_line *grid_peek_line(struct grid *, u_int);
+void	 grid_expand_lines(struct grid *, u_int);
 void	 grid_collect_history(struct grid *);
+void	 grid_compress_history(struct grid *);
 void	 grid_scroll_history(struct grid *);
 void	 grid_scroll_history_region(struct grid *, u_int, u_int);
 void	 grid_expand_line(struct grid *, u_int, u_int);
-void	 grid_expand_line_utf8(struct grid *, u_int, u_int);
 const struct grid_cell *grid_peek_cell(struct grid *, u_int, u_int);
 struct grid_cell *grid_get_cell(struct grid *, u_int, u_int);
 void	 grid_set_cell(struct grid *, u_int, u_int, const struct grid_cell *);
-const struct grid_utf8 *grid_peek_utf8(struct grid *, u_int, u_int);
-struct grid_utf8 *grid_get_utf8(struct grid *, u_int, u_int);
-void	 grid_set_utf8(struct grid *, u_int, u_int, const struct grid_utf8 *);
+void	 grid_set_cells(struct grid *, u_int, u_int, const struct grid_cell *,
+	     const u_char *, u_int);
 void	 grid_clear(struct grid *, u_int, u_int, u_int, u_int);
 void	 grid_clear_lines(struct grid *, u_int, u_int);
+void	 grid_clear_history(struct grid *);
 void	 grid_move_lines(struct grid *, u_int, u_int, u_int);
 void	 grid_move_cells(struct grid *, u_int, u_int, u_int, u_int);
 char	*grid_string_cells(struct grid *, u_int, u_int, u_int);
+int	 grid_may_contain(struct grid *, u_int, struct grid *);
 void	 grid_duplicate_lines(
 	     struct grid *, u_int, struct grid *, u_int, u_int);
+void	 grid_mark_utf8(struct grid *);
+
+/* grid-compress.c */
+void	 grid_pack_line(struct grid_line *);
+void	 grid_compress_line(struct grid *, struct grid_line *);
+void	 grid_unpack_line(struct grid *, struct grid_line *);
+void	 grid_free_packed(struct grid *, struct grid_line *);
+size_t	 grid_packed_size(const struct grid_line *);
+char	*grid_packed_string(const struct grid_line *, u_int, u_int);
+int	 grid_packed_find(const struct grid_line *, const struct grid_cell *,
+	     u_int);
+void	 grid_packed_mark(const struct grid_line *);
 
 /* grid-utf8.c */
 size_t	 grid_utf8_size(const struct grid_utf8 *);
 size_t	 grid_utf8_copy(const struct grid_utf8 *, char *, size_t);
-void	 grid_utf8_set(struct grid_utf8 *, const struct utf8_data *);
-int	 grid_utf8_append(struct grid_utf8 *, const struct utf8_data *);
-int	 grid_utf8_compare(const struct grid_utf8 *, const struct grid_utf8 *);
+void	 grid_utf8_get(const struct grid_cell *, struct grid_utf8 *);
+void	 grid_utf8_put(struct grid_cell *, const struct grid_utf8 *);
+void	 grid_utf8_set(struct grid_cell *, const struct utf8_data *);
+int	 grid_utf8_append(struct grid_cell *, const struct utf8_data *);
+void	 grid_utf8_mark(u_int);
+void	 grid_utf8_mark_cells(const struct grid_cell *, u_int);
+u_int	 grid_utf8_entries(void);
 
 /* grid-view.c */
 const struct grid_cell *grid_view_peek_cell(struct grid *, u_int, u_int);
 struct grid_cell *grid_view_get_cell(struct grid *, u_int, u_int);
 void	 grid_view_set_cell(
 	     struct grid *, u_int, u_int, const struct grid_cell *);
-const struct grid_utf8 *grid_view_peek_utf8(struct grid *, u_int, u_int);
-struct grid_utf8 *grid_view_get_utf8(struct grid *, u_int, u_int);
-void	 grid_view_set_utf8(
-	     struct grid *, u_int, u_int, const struct grid_utf8 *);
+void	 grid_view_set_cells(struct grid *, u_int, u_int,
+	     const struct grid_cell *, const u_char *, u_int);
 void	 grid_view_clear_history(struct grid *);
 void	 grid_view_clear(struct grid *, u_int, u_int, u_int, u_int);
 void	 grid_view_scroll_region_up(struct grid *, u_int, u_int);
@@ -2034,6 +2234,8 @@ void	 screen_write_clearscreen(struct screen_write_ctx *);
 void	 screen_write_clearhistory(struct screen_write_ctx *);
 void	 screen_write_cell(struct screen_write_ctx *,
 	     const struct grid_cell *, const struct utf8_data *);
+void	 screen_write_cells(struct screen_write_ctx *,
+	     const struct grid_cell *, const u_char *, u_int);
 void	 screen_write_setselection(struct screen_write_ctx *, u_char *, u_int);
 void	 screen_write_rawstring(struct screen_write_ctx *, u_char *, u_int);
 void	 screen_write_bracketpaste(struct screen_write_ctx *, int);
@@ -2041,12 +2243,21 @@ void	 screen_write_bracketpaste(struct screen_write_ctx *, int);
 /* screen-redraw.c */
 void	 screen_redraw_screen(struct client *, int, int);
 void	 screen_redraw_pane(struct client *, struct window_pane *);
+void	 screen_redraw_changed(struct client *, struct window_pane *);
+void	 screen_redraw_frame(struct client *);
 
 /* screen.c */
 void	 screen_init(struct screen *, u_int, u_int, u_int);
 void	 screen_reinit(struct screen *);
 void	 screen_free(struct screen *);
 void	 screen_reset_tabs(struct screen *);
+void	 screen_reset_dirty(struct screen *);
+void	 screen_dirty_lines(struct screen *, u_int, u_int);
+void	 screen_clear_dirty(struct screen *);
+void	 screen_set_unsearched(struct screen *, u_int, u_int);
+int	 screen_line_unsearched(struct screen *, u_int);
+void	 screen_clear_unsearched(struct screen *);
+void	 screen_scroll_lines(struct screen *, u_int, u_int, int);
 void	 screen_set_cursor_style(struct screen *, u_int);
 void	 screen_set_cursor_colour(struct screen *, const char *);
 void	 screen_set_title(struct screen *, const char *);
@@ -2058,11 +2269,19 @@ int	 screen_check_selection(struct screen *, u_int, u_int);
 
 /* window.c */
 extern struct windows windows;
+extern struct window_tree all_windows;
 extern struct window_pane_tree all_window_panes;
+extern struct window_pane_pid_tree all_window_pane_pids;
 int		 winlink_cmp(struct winlink *, struct winlink *);
 RB_PROTOTYPE(winlinks, winlink, entry, winlink_cmp);
+int		 window_cmp(struct window *, struct window *);
+RB_PROTOTYPE(window_tree, window, tree_entry, window_cmp);
 int		 window_pane_cmp(struct window_pane *, struct window_pane *);
 RB_PROTOTYPE(window_pane_tree, window_pane, tree_entry, window_pane_cmp);
+int		 window_pane_pid_cmp(
+		     struct window_pane *, struct window_pane *);
+RB_PROTOTYPE(window_pane_pid_tree, window_pane, pid_entry,
+    window_pane_pid_cmp);
 struct winlink	*winlink_find_by_index(struct winlinks *, int);
 struct winlink	*winlink_find_by_window(struct winlinks *, struct window *);
 struct winlink	*winlink_find_by_window_id(struct winlinks *, u_int);
@@ -2086,6 +2305,8 @@ struct window	*window_create(const char *, const char *, const char *,
 		     const char *, struct environ *, struct termios *,
 		     u_int, u_int, u_int, char **);
 void		 window_destroy(struct window *);
+void		 window_map_invalidate(struct window *);
+int		 window_map_cell(struct window *, u_int, u_int);
 struct window_pane *window_get_active_at(struct window *, u_int, u_int);
 void		 window_set_active_at(struct window *, u_int, u_int);
 struct window_pane *window_find_string(struct window *, const char *);
@@ -2102,9 +2323,12 @@ int		 window_pane_index(struct window_pane *, u_int *);
 u_int		 window_count_panes(struct window *);
 void		 window_destroy_panes(struct window *);
 struct window_pane *window_pane_find_by_id(u_int);
+struct window_pane *window_pane_find_by_pid(pid_t);
+void		 window_pane_remove_pid(struct window_pane *);
 struct window_pane *window_pane_create(struct window *, u_int, u_int, u_int);
 void		 window_pane_destroy(struct window_pane *);
 void		 window_pane_timer_start(struct window_pane *);
+void		 window_pane_mode_timers(void);
 int		 window_pane_spawn(struct window_pane *, const char *,
 		     const char *, const char *, struct environ *,
 		     struct termios *, char **);
@@ -2122,6 +2346,8 @@ void		 window_pane_mouse(struct window_pane *,
 int		 window_pane_visible(struct window_pane *);
 char		*window_pane_search(
 		     struct window_pane *, const char *, u_int *);
+int		 window_pane_search_changed(
+		     struct window_pane *, const char *);
 char		*window_printable_flags(struct session *, struct winlink *);
 struct window_pane *window_pane_find_up(struct window_pane *);
 struct window_pane *window_pane_find_down(struct window_pane *);
@@ -0,0 +1,60 @@
+# $Id$
+#
+# Print 29 lines of coloured text for the benchmarks in this directory, the
+# same each time. By default this is words each with their own attributes and
+# colours and a reset after; with -r it is random attribute and colour changes
+# with some line drawing characters.
+#
+#	python3 tools/gen-words.py [-r]
+
+import random
+import sys
+
+
+def words():
+    random.seed(7)
+    words = ["int", "return", "static", "void", "struct", "if", "else", "for",
+        "x", "tty", "0", "NULL"]
+    out = []
+    for i in range(29):
+        line = ""
+        n = 0
+        while n < 95:
+            w = random.choice(words)
+            a = random.choice(["", "1", "4", "1;4", "7", "2", "3"])
+            c = random.choice(["", "31", "32", "33", "34",
+                "38;5;%d" % random.randint(16, 255), "91"])
+            b = random.choice(["", "", "", "44",
+                "48;5;%d" % random.randint(16, 255)])
+            seq = ";".join(x for x in (a, c, b) if x)
+            line += "\033[0;%sm%s\033[0m " % (seq, w)
+            n += len(w) + 1
+        out.append(line)
+    return out
+
+
+def changes():
+    random.seed(11)
+    ops = ["1", "2", "3", "4", "5", "7", "8", "22", "23", "24", "25", "27",
+        "28", "39", "49", "31", "32", "94", "104", "44", "38;5;200",
+        "48;5;17", "38;5;3", "0", "7;1", "22;1"]
+    out = []
+    for i in range(29):
+        line = ""
+        n = 0
+        while n < 96:
+            k = random.randint(1, 3)
+            line += "\033[%sm" % ";".join(random.choice(ops)
+                for _ in range(k))
+            w = random.choice(["ab", "c", "def", " ", "x\033(0q\033(By"])
+            line += w
+            n += len(w) if "(" not in w else 3
+        out.append(line + "\033[0m")
+    return out
+
+
+if len(sys.argv) > 1 and sys.argv[1] == "-r":
+    lines = changes()
+else:
+    lines = words()
+print("\n".join(lines), end="")
@@ -0,0 +1,57 @@
+# $Id$
+#
+# Print the write(2) calls and CPU time used by the server for each full redraw
+# of a 200x50 client with four tiled panes of coloured text from
+# tools/gen-words.py. Any flags after the tmux binary are passed to it, so
+# -vvvv measures with the tty log open.
+# The counts are read from /proc, so this only works on Linux. Needs python3
+# and script(1) from util-linux.
+#
+#	sh tools/redraw-bench.sh ./tmux [-vvvv]
+
+BIN=$1
+shift
+export TERM=xterm-256color
+PYTHON=${PYTHON:-python3}
+R=${R:-200}
+HZ=$(getconf CLK_TCK)
+GEN="$PYTHON $(cd $(dirname $0) && pwd)/gen-words.py"
+
+DIR=$(mktemp -d) || exit 1
+trap "rm -rf $DIR" 0
+
+# The tty log is written to the current directory.
+cd $DIR || exit 1
+
+T="$BIN $* -f/dev/null -Lredraw-bench"
+$T kill-server 2>/dev/null
+$T new -d -x200 -y50 "$GEN; sleep 100" \; \
+    set -g status off >/dev/null || exit 1
+for i in 1 2 3; do
+	$T splitw "$GEN; sleep 100" >/dev/null
+done
+$T selectl tiled >/dev/null
+
+(
+	sleep 2
+	pid=$(ps -o ppid= -p $($T lsp -F '#{pane_pid}' | head -1) | tr -d ' ')
+	c=$($T lsc -F '#{client_tty}')
+
+	w0=$(awk '/syscw/ { print $2 }' /proc/$pid/io)
+	t0=$(awk '{ print $14 + $15 }' /proc/$pid/stat)
+	i=0
+	while [ $i -lt $R ]; do
+		$T refresh-client -t$c
+		i=$((i + 1))
+	done
+	sleep 1
+	w1=$(awk '/syscw/ { print $2 }' /proc/$pid/io)
+	t1=$(awk '{ print $14 + $15 }' /proc/$pid/stat)
+
+	echo "$BIN $*: $(( (w1 - w0) / R )) writes," \
+	    "$(( (t1 - t0) * 1000000 / HZ / R )) us CPU per redraw"
+	$T kill-server
+) &
+script -qfc "stty rows 50 cols 200; $T attach" /dev/null \
+    >/dev/null 2>&1 </dev/null
+wait
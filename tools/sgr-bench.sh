@@ -0,0 +1,46 @@
+# $Id$
+#
+# Print the bytes sent to an attached client for each full redraw of a 100x29
+# pane of coloured text, for each tmux binary given. The terminal is $TERM
+# (default xterm-256color) and the text from tools/gen-words.py is either words
+# each with their own attributes and a reset after, or with -r random
+# attribute and colour changes. Needs python3 and script(1) from util-linux.
+#
+#	sh tools/sgr-bench.sh [-r] ./tmux.old ./tmux
+
+TEXT=words
+FLAGS=
+if [ "$1" = "-r" ]; then
+	TEXT=random
+	FLAGS=-r
+	shift
+fi
+export TERM=${TERM:-xterm-256color}
+PYTHON=${PYTHON:-python3}
+GEN="$PYTHON $(cd $(dirname $0) && pwd)/gen-words.py $FLAGS"
+
+DIR=$(mktemp -d) || exit 1
+trap "rm -rf $DIR" 0
+
+for BIN in "$@"; do
+	T="$BIN -f/dev/null -Lsgr-bench"
+	$T kill-server 2>/dev/null
+	$T new -d -x100 -y30 "$GEN; sleep 100" \; \
+	    set -g status off >/dev/null || exit 1
+	(
+		sleep 2
+		wc -c <$DIR/out >$DIR/before
+		for i in 1 2 3 4 5 6 7 8 9 10; do
+			$T refresh-client
+			sleep 0.2
+		done
+		sleep 0.5
+		wc -c <$DIR/out >$DIR/after
+		$T kill-server
+	) &
+	script -qfc "stty rows 30 cols 100; $T attach" $DIR/out \
+	    >/dev/null 2>&1 </dev/null
+	wait
+	echo "$BIN ($TERM, $TEXT):" \
+	    $(( ($(cat $DIR/after) - $(cat $DIR/before)) / 10 )) bytes per redraw
+done
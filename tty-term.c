@@ -32,12 +32,17 @@
 
 void	 tty_term_override(struct tty_term *, const char *);
 char	*tty_term_strip(const char *);
+struct tty_term_fmt *tty_term_compile(const char *);
+const char *tty_term_expand(struct tty_term_fmt *, int, int);
+int	 tty_term_sgr(struct tty_term *, enum tty_code_code);
+void	 tty_term_check_sgr(struct tty_term *);
 
 struct tty_terms tty_terms = LIST_HEAD_INITIALIZER(tty_terms);
 
 const struct tty_term_code_entry tty_term_codes[NTTYCODE] = {
 	{ TTYC_ACSC, TTYCODE_STRING, "acsc" },
 	{ TTYC_AX, TTYCODE_FLAG, "AX" },
+	{ TTYC_BCE, TTYCODE_FLAG, "bce" },
 	{ TTYC_BEL, TTYCODE_STRING, "bel" },
 	{ TTYC_BLINK, TTYCODE_STRING, "blink" },
 	{ TTYC_BOLD, TTYCODE_STRING, "bold" },
@@ -64,10 +69,13 @@ const struct tty_term_code_entry tty_term_codes[NTTYCODE] = {
 	{ TTYC_DIM, TTYCODE_STRING, "dim" },
 	{ TTYC_DL, TTYCODE_STRING, "dl" },
 	{ TTYC_DL1, TTYCODE_STRING, "dl1" },
+	{ TTYC_DSMG, TTYCODE_STRING, "Dsmg" },
 	{ TTYC_E3, TTYCODE_STRING, "E3" },
+	{ TTYC_ECH, TTYCODE_STRING, "ech" },
 	{ TTYC_EL, TTYCODE_STRING, "el" },
 	{ TTYC_EL1, TTYCODE_STRING, "el1" },
 	{ TTYC_ENACS, TTYCODE_STRING, "enacs" },
+	{ TTYC_ENMG, TTYCODE_STRING, "Enmg" },
 	{ TTYC_FSL, TTYCODE_STRING, "fsl" },
 	{ TTYC_HOME, TTYCODE_STRING, "home" },
 	{ TTYC_HPA, TTYCODE_STRING, "hpa" },
@@ -173,6 +181,7 @@ const struct tty_term_code_entry tty_term_codes[NTTYCODE] = {
 	{ TTYC_KUP7, TTYCODE_STRING, "kUP7" },
 	{ TTYC_MS, TTYCODE_STRING, "Ms" },
 	{ TTYC_OP, TTYCODE_STRING, "op" },
+	{ TTYC_REP, TTYCODE_STRING, "rep" },
 	{ TTYC_REV, TTYCODE_STRING, "rev" },
 	{ TTYC_RI, TTYCODE_STRING, "ri" },
 	{ TTYC_RMACS, TTYCODE_STRING, "rmacs" },
@@ -184,15 +193,32 @@ const struct tty_term_code_entry tty_term_codes[NTTYCODE] = {
 	{ TTYC_SITM, TTYCODE_STRING, "sitm" },
 	{ TTYC_SMACS, TTYCODE_STRING, "smacs" },
 	{ TTYC_SMCUP, TTYCODE_STRING, "smcup" },
+	{ TTYC_SMGLR, TTYCODE_STRING, "Smglr" },
 	{ TTYC_SMKX, TTYCODE_STRING, "smkx" },
 	{ TTYC_SMSO, TTYCODE_STRING, "smso" },
 	{ TTYC_SMUL, TTYCODE_STRING, "smul" },
+	{ TTYC_SYNC, TTYCODE_STRING, "Sync" },
 	{ TTYC_TSL, TTYCODE_STRING, "tsl" },
 	{ TTYC_VPA, TTYCODE_STRING, "vpa" },
 	{ TTYC_XENL, TTYCODE_FLAG, "xenl" },
 	{ TTYC_XT, TTYCODE_FLAG, "XT" },
 };
 
+/* Codes with arguments whose length is needed for cursor movement. */
+const struct {
+	enum tty_code_code	code;
+	u_int			args;
+} tty_term_cost_codes[] = {
+	{ TTYC_CUB, 1 },
+	{ TTYC_CUD, 1 },
+	{ TTYC_CUF, 1 },
+	{ TTYC_CUP, 2 },
+	{ TTYC_CUU, 1 },
+	{ TTYC_ECH, 1 },
+	{ TTYC_HPA, 1 },
+	{ TTYC_VPA, 1 },
+};
+
 char *
 tty_term_strip(const char *s)
 {
@@ -330,6 +356,8 @@ tty_term_find(char *name, int fd, const char *overrides, char **cause)
 	term->references = 1;
 	term->flags = 0;
 	memset(term->codes, 0, sizeof term->codes);
+	memset(term->fmts, 0, sizeof term->fmts);
+	memset(term->colours, 0, sizeof term->colours);
 	LIST_INSERT_HEAD(&tty_terms, term, entry);
 
 	/* Set up curses terminal. */
@@ -436,6 +464,39 @@ tty_term_find(char *name, int fd, const char *overrides, char **cause)
 	for (; acs[0] != '\0' && acs[1] != '\0'; acs += 2)
 		term->acs[(u_char) acs[0]][0] = acs[1];
 
+	/* Compile any codes with arguments which are simple enough. */
+	for (i = 0; i < NTTYCODE; i++) {
+		code = &term->codes[i];
+		if (code->type == TTYCODE_STRING &&
+		    strchr(code->value.string, '%') != NULL)
+			term->fmts[i] = tty_term_compile(code->value.string);
+	}
+
+	/*
+	 * Work out the length of each code, for choosing how to move the
+	 * cursor. Codes with arguments are expanded with single digits which
+	 * are then taken off, so the length of the real arguments can be added
+	 * later.
+	 */
+	for (i = 0; i < NTTYCODE; i++) {
+		term->costs[i] = 0;
+		if (term->codes[i].type == TTYCODE_STRING)
+			term->costs[i] = strlen(term->codes[i].value.string);
+	}
+	for (i = 0; i < nitems(tty_term_cost_codes); i++) {
+		n = tty_term_cost_codes[i].args;
+		if (!tty_term_has(term, tty_term_cost_codes[i].code))
+			continue;
+		s = (char *) tty_term_string2(term,
+		    tty_term_cost_codes[i].code, 1, 1);
+		if (strlen(s) > (size_t) n)
+			term->costs[tty_term_cost_codes[i].code] =
+			    strlen(s) - n;
+	}
+
+	/* Work out if attributes can be combined into one SGR sequence. */
+	tty_term_check_sgr(term);
+
 	/* On terminals with xterm titles (XT), fill in tsl and fsl. */
 	if (tty_term_flag(term, TTYC_XT) &&
 	    !tty_term_has(term, TTYC_TSL) &&
@@ -455,10 +516,105 @@ error:
 	return (NULL);
 }
 
+/*
+ * Return the parameter if a code is a single plain SGR sequence, 0 if it is
+ * missing or -1 if it is anything else.
+ */
+int
+tty_term_sgr(struct tty_term *term, enum tty_code_code code)
+{
+	const char	*s;
+	int		 n;
+
+	if (!tty_term_has(term, code))
+		return (0);
+	s = tty_term_string(term, code);
+	if (s[0] != '\033' || s[1] != '[')
+		return (-1);
+	n = 0;
+	for (s += 2; *s >= '0' && *s <= '9'; s++) {
+		n = n * 10 + (*s - '0');
+		if (n > 255)
+			return (-1);
+	}
+	if (n == 0 || s[0] != 'm' || s[1] != '\0')
+		return (-1);
+	return (n);
+}
+
+/*
+ * Check if the attributes and colours are all plain SGR so several can be sent
+ * as one sequence, and save the parameter for each attribute.
+ */
+void
+tty_term_check_sgr(struct tty_term *term)
+{
+	const char	*s;
+	char		 tmp[16];
+	int		 n, i;
+
+	memset(term->sgr, 0, sizeof term->sgr);
+
+	s = tty_term_string(term, TTYC_SGR0);
+	if (strstr(s, "\033[m") == NULL && strstr(s, "\033[0m") == NULL)
+		return;
+	if (!tty_term_has(term, TTYC_SETAF) || !tty_term_has(term, TTYC_SETAB))
+		return;
+	for (i = 0; i < 8; i++) {
+		xsnprintf(tmp, sizeof tmp, "\033[%dm", 30 + i);
+		if (strcmp(tty_term_string1(term, TTYC_SETAF, i), tmp) != 0)
+			return;
+		xsnprintf(tmp, sizeof tmp, "\033[%dm", 40 + i);
+		if (strcmp(tty_term_string1(term, TTYC_SETAB, i), tmp) != 0)
+			return;
+	}
+
+	/* Indexed by attribute bit, the same codes as tty_attributes. */
+	for (i = 0; i < (int) nitems(term->sgr); i++) {
+		switch (1 << i) {
+		case GRID_ATTR_BRIGHT:
+			n = tty_term_sgr(term, TTYC_BOLD);
+			break;
+		case GRID_ATTR_DIM:
+			n = tty_term_sgr(term, TTYC_DIM);
+			break;
+		case GRID_ATTR_UNDERSCORE:
+			n = tty_term_sgr(term, TTYC_SMUL);
+			break;
+		case GRID_ATTR_BLINK:
+			n = tty_term_sgr(term, TTYC_BLINK);
+			break;
+		case GRID_ATTR_REVERSE:
+			if (tty_term_has(term, TTYC_REV))
+				n = tty_term_sgr(term, TTYC_REV);
+			else
+				n = tty_term_sgr(term, TTYC_SMSO);
+			break;
+		case GRID_ATTR_HIDDEN:
+			n = tty_term_sgr(term, TTYC_INVIS);
+			break;
+		case GRID_ATTR_ITALICS:
+			if (tty_term_has(term, TTYC_SITM))
+				n = tty_term_sgr(term, TTYC_SITM);
+			else
+				n = tty_term_sgr(term, TTYC_SMSO);
+			break;
+		default:
+			n = 0;
+			break;
+		}
+		if (n == -1)
+			return;
+		term->sgr[i] = n;
+	}
+
+	term->flags |= TERM_SGR;
+}
+
 void
 tty_term_free(struct tty_term *term)
 {
-	u_int	i;
+	u_int	i, j;
 
 	if (--term->references != 0)
 		return;
@@ -468,6 +624,15 @@ tty_term_free(struct tty_term *term)
 	for (i = 0; i < NTTYCODE; i++) {
 		if (term->codes[i].type == TTYCODE_STRING)
 			free(term->codes[i].value.string);
+		if (term->fmts[i] != NULL) {
+			for (j = 0; j <= term->fmts[i]->n; j++)
+				free(term->fmts[i]->text[j]);
+			free(term->fmts[i]);
+		}
+	}
+	for (i = 0; i < 256; i++) {
+		free(term->colours[0][i]);
+		free(term->colours[1][i]);
 	}
 	free(term->name);
 	free(term);
@@ -489,16 +654,133 @@ tty_term_string(struct tty_term *term, enum tty_code_code code)
 	return (term->codes[code].value.string);
 }
 
+/*
+ * Compile a code into the text around each argument. Only %p1 or %p2 followed
+ * by %d, %i at the start and %% are understood; anything else is left for
+ * tparm.
+ */
+struct tty_term_fmt *
+tty_term_compile(const char *s)
+{
+	struct tty_term_fmt	*fmt;
+	char			*text;
+	size_t			 len;
+	u_int			 i;
+
+	fmt = xcalloc(1, sizeof *fmt);
+	text = xmalloc(strlen(s) + 1);
+	len = 0;
+	for (; *s != '\0'; s++) {
+		if (*s != '%') {
+			text[len++] = *s;
+			continue;
+		}
+		switch (*++s) {
+		case '%':
+			text[len++] = '%';
+			continue;
+		case 'i':
+			if (fmt->n == 0) {
+				fmt->incr = 1;
+				continue;
+			}
+			goto fail;
+		case 'p':
+			if ((s[1] != '1' && s[1] != '2') ||
+			    s[2] != '%' || s[3] != 'd')
+				goto fail;
+			if (fmt->n == TTY_TERM_FMT_ARGS)
+				goto fail;
+			text[len] = '\0';
+			fmt->text[fmt->n] = xstrdup(text);
+			fmt->arg[fmt->n++] = s[1] - '1';
+			len = 0;
+			s += 3;
+			continue;
+		}
+		goto fail;
+	}
+	text[len] = '\0';
+	fmt->text[fmt->n] = xstrdup(text);
+	free(text);
+	return (fmt);
+
+fail:
+	for (i = 0; i < fmt->n; i++)
+		free(fmt->text[i]);
+	free(fmt);
+	free(text);
+	return (NULL);
+}
+
+/* Expand a compiled code, in the same way as tparm. */
+const char *
+tty_term_expand(struct tty_term_fmt *fmt, int a, int b)
+{
+	static char	 buf[BUFSIZ];
+	char		 num[16], *ptr;
+	size_t		 len, size;
+	u_int		 i;
+	int		 v;
+
+	len = 0;
+	for (i = 0; i <= fmt->n; i++) {
+		size = strlen(fmt->text[i]);
+		if (len + size >= sizeof buf)
+			break;
+		memcpy(buf + len, fmt->text[i], size);
+		len += size;
+		if (i == fmt->n)
+			break;
+
+		v = fmt->arg[i] == 0 ? a : b;
+		if (fmt->incr)
+			v++;
+		ptr = num + sizeof num;
+		do
+			*--ptr = '0' + v % 10;
+		while ((v /= 10) != 0);
+		size = num + sizeof num - ptr;
+		if (len + size >= sizeof buf)
+			break;
+		memcpy(buf + len, ptr, size);
+		len += size;
+	}
+	buf[len] = '\0';
+	return (buf);
+}
+
 /* No vtparm. Fucking curses. */
 const char *
 tty_term_string1(struct tty_term *term, enum tty_code_code code, int a)
 {
-	return (tparm((char *) tty_term_string(term, code), a, 0, 0, 0, 0, 0, 0, 0, 0));
+	const char	*s;
+	char		**cache;
+
+	/* Colours are used often enough to keep them once expanded. */
+	cache = NULL;
+	if ((code == TTYC_SETAF || code == TTYC_SETAB) && a >= 0 && a < 256) {
+		cache = &term->colours[code == TTYC_SETAB][a];
+		if (*cache != NULL)
+			return (*cache);
+	}
+
+	if (term->fmts[code] != NULL)
+		s = tty_term_expand(term->fmts[code], a, 0);
+	else
+		s = tparm((char *) tty_term_string(term, code),
+		    a, 0, 0, 0, 0, 0, 0, 0, 0);
+
+	if (cache != NULL)
+		*cache = xstrdup(s);
+	return (s);
 }
 
 const char *
 tty_term_string2(struct tty_term *term, enum tty_code_code code, int a, int b)
 {
+	if (term->fmts[code] != NULL)
+		return (tty_term_expand(term->fmts[code], a, b));
 	return (tparm((char *) tty_term_string(term, code), a, b, 0, 0, 0, 0, 0, 0, 0));
 }
 
@@ -514,6 +796,36 @@ tty_term_ptr2(struct tty_term *term, enum tty_code_code code, const void *a, con
 	return (tparm((char *) tty_term_string(term, code), a, b, 0, 0, 0, 0, 0, 0, 0));
 }
 
+/* Length of a code. */
+u_int
+tty_term_cost(struct tty_term *term, enum tty_code_code code)
+{
+	return (term->costs[code]);
+}
+
+/*
+ * Approximate length of a code expanded with arguments. Some codes add one to
+ * their arguments, so this can be a byte short.
+ */
+u_int
+tty_term_cost1(struct tty_term *term, enum tty_code_code code, int a)
+{
+	u_int	n;
+
+	n = term->costs[code];
+	do
+		n++;
+	while ((a /= 10) != 0);
+	return (n);
+}
+
+u_int
+tty_term_cost2(struct tty_term *term, enum tty_code_code code, int a, int b)
+{
+	return (tty_term_cost1(term, code, a) + tty_term_cost1(term, code, b) -
+	    term->costs[code]);
+}
+
 int
 tty_term_number(struct tty_term *term, enum tty_code_code code)
 {
@@ -32,11 +32,19 @@
 #include "tmux.h"
 
 void	tty_read_callback(struct bufferevent *, void *);
+void	tty_write_callback(struct bufferevent *, void *);
 void	tty_error_callback(struct bufferevent *, short, void *);
+void	tty_send(struct tty *, const void *, size_t);
+void	tty_add(struct tty *, const void *, size_t);
+void	tty_save_state(struct tty *, struct tty_state *);
+int	tty_same(struct tty *, struct tty_state *);
 
 int	tty_try_256(struct tty *, u_char, const char *);
 int	tty_try_88(struct tty *, u_char, const char *);
 
+void	tty_attributes_sgr(struct tty *, const struct grid_cell *);
+void	tty_sgr_add(char *, size_t, u_int);
+void	tty_sgr_colour(struct tty *, char *, size_t, u_char, int, int);
 void	tty_colours(struct tty *, const struct grid_cell *);
 void	tty_check_fg(struct tty *, struct grid_cell *);
 void	tty_check_bg(struct tty *, struct grid_cell *);
@@ -48,12 +56,38 @@ void	tty_redraw_region(struct tty *, const struct tty_ctx *);
 void	tty_emulate_repeat(
 	    struct tty *, enum tty_code_code, enum tty_code_code, u_int);
 void	tty_repeat_space(struct tty *, u_int);
-void	tty_cell(struct tty *,
-	    const struct grid_cell *, const struct grid_utf8 *);
+void	tty_repeat_char(struct tty *, u_char, u_int);
+void	tty_repeat_cell(struct tty *, const struct grid_cell *, u_int);
+const struct grid_cell *tty_line_cell(
+	    struct screen *, u_int, u_int, struct grid_cell *);
+void	tty_cell(struct tty *, const struct grid_cell *);
+u_int	tty_cursor_cost_y(struct tty *, u_int, int *);
+u_int	tty_cursor_cost_x(struct tty *, u_int, u_int, u_int, int *);
+int	tty_cursor_cells(struct tty *, u_int, u_int, u_int);
+void	tty_cursor_move_y(struct tty *, u_int, int);
+void	tty_cursor_move_x(struct tty *, u_int, u_int, u_int, int);
+void	tty_frame_free(struct tty *);
+
+/* Ways of moving the cursor along a row or column. */
+#define TTY_MOVE_NONE 0
+#define TTY_MOVE_ABSOLUTE 1	/* HPA or VPA */
+#define TTY_MOVE_ONE 2		/* single steps, CUU1 and so on */
+#define TTY_MOVE_MANY 3		/* CUU and so on with a count */
+#define TTY_MOVE_LINEFEED 4	/* line feeds */
+#define TTY_MOVE_CELLS 5	/* writing cells already there */
+
+/* SGR parameters to set and clear each attribute, indexed by bit. */
+const u_char tty_sgr_on[] = { 1, 2, 4, 5, 7, 8, 3 };
+const u_char tty_sgr_off[] = { 22, 22, 24, 25, 27, 28, 23 };
 
 #define tty_use_acs(tty) \
 	(tty_term_has((tty)->term, TTYC_ACSC) && !((tty)->flags & TTY_UTF8))
 
+#define tty_use_margin(tty) \
+	(tty_term_has((tty)->term, TTYC_ENMG) && \
+	tty_term_has((tty)->term, TTYC_DSMG) && \
+	tty_term_has((tty)->term, TTYC_SMGLR))
+
 #define tty_pane_full_width(tty, ctx) \
 	((ctx)->xoff == 0 && screen_size_x((ctx)->wp->screen) >= (tty)->sx)
 
@@ -113,6 +147,7 @@ tty_resize(struct tty *tty)
 	 * cursor position, as this may not have happened.
 	 */
 	if (tty->flags & TTY_STARTED) {
+		tty_margin_off(tty);
 		tty_cursor(tty, 0, 0);
 		tty_region(tty, 0, tty->sy - 1);
 	}
@@ -126,6 +161,7 @@ tty_set_size(struct tty *tty, u_int sx, u_int sy) {
 		return (0);
 	tty->sx = sx;
 	tty->sy = sy;
+	tty_frame_free(tty);
 	return (1);
 }
 
@@ -152,8 +188,10 @@ tty_open(struct tty *tty, const char *overrides, char **cause)
 
 	tty->flags &= ~(TTY_NOCURSOR|TTY_FREEZE|TTY_ESCAPE);
 
-	tty->event = bufferevent_new(
-	    tty->fd, tty_read_callback, NULL, tty_error_callback, tty);
+	tty->event = bufferevent_new(tty->fd,
+	    tty_read_callback, tty_write_callback, tty_error_callback, tty);
+	tty->out = xmalloc(TTY_OUTSIZE);
+	tty->outlen = 0;
 
 	tty_start_tty(tty);
 
@@ -172,6 +210,34 @@ tty_read_callback(unused struct bufferevent *bufev, void *data)
 		;
 }
 
+/*
+ * Output has been written. If updates were stopped and enough has gone, start
+ * them again with a redraw of whatever was missed.
+ */
+/* ARGSUSED */
+void
+tty_write_callback(unused struct bufferevent *bufev, void *data)
+{
+	struct tty	*tty = data;
+	struct client	*c = tty->client;
+	size_t		 size;
+
+	if (!(tty->flags & TTY_BLOCK))
+		return;
+
+	size = tty->outlen + EVBUFFER_LENGTH(tty->event->output);
+	if (size > TTY_BLOCK_STOP(tty))
+		return;
+	log_debug("%s unblocked (%zu bytes)", tty->path, size);
+
+	tty->flags &= ~TTY_BLOCK;
+	tty->redraws++;
+	if (tty->flags & TTY_DIFF)
+		c->flags |= CLIENT_FRAME;
+	else
+		server_redraw_client(c);
+}
+
 /* ARGSUSED */
 void
 tty_error_callback(
@@ -231,6 +297,8 @@ tty_start_tty(struct tty *tty)
 
 	tty->rlower = UINT_MAX;
 	tty->rupper = UINT_MAX;
+	tty->rleft = UINT_MAX;
+	tty->rright = UINT_MAX;
 
 	tty->mode = MODE_CURSOR;
 
@@ -256,6 +324,7 @@ tty_stop_tty(struct tty *tty)
 		return;
 	tty->flags &= ~TTY_STARTED;
 
+	tty_flush(tty);
 	bufferevent_disable(tty->event, EV_READ|EV_WRITE);
 
 	/*
@@ -271,6 +340,8 @@ tty_stop_tty(struct tty *tty)
 	setblocking(tty->fd, 1);
 
 	tty_raw(tty, tty_term_string2(tty->term, TTYC_CSR, 0, ws.ws_row - 1));
+	if (tty_use_margin(tty))
+		tty_raw(tty, tty_term_string(tty->term, TTYC_DSMG));
 	if (tty_use_acs(tty))
 		tty_raw(tty, tty_term_string(tty->term, TTYC_RMACS));
 	tty_raw(tty, tty_term_string(tty->term, TTYC_SGR0));
@@ -308,6 +379,7 @@ tty_close(struct tty *tty)
 
 	if (tty->flags & TTY_OPENED) {
 		bufferevent_free(tty->event);
+		free(tty->out);
 
 		tty_term_free(tty->term);
 		tty_keys_free(tty);
@@ -326,6 +398,7 @@ tty_free(struct tty *tty)
 {
 	tty_close(tty);
 
+	tty_frame_free(tty);
 	free(tty->ccolour);
 	if (tty->path != NULL)
 		free(tty->path);
@@ -333,6 +406,96 @@ tty_free(struct tty *tty)
 		free(tty->termname);
 }
 
+/*
+ * Pass output to the terminal and the log. If it could change more than one
+ * line and the terminal supports it, a synchronized update is started first so
+ * the terminal shows everything up to the next flush at once.
+ */
+void
+tty_send(struct tty *tty, const void *buf, size_t len)
+{
+	const char	*s;
+
+	if (!(tty->flags & TTY_SYNC) && (tty->flags & TTY_STARTED) &&
+	    tty_term_has(tty->term, TTYC_SYNC) && len > tty->sx) {
+		s = tty_term_string1(tty->term, TTYC_SYNC, 1);
+		bufferevent_write(tty->event, s, strlen(s));
+		tty->flags |= TTY_SYNC;
+	}
+
+	bufferevent_write(tty->event, buf, len);
+	if (tty->log_fd != -1)
+		write(tty->log_fd, buf, len);
+}
+
+/* Pass output collected since the last flush to the terminal. */
+void
+tty_flush(struct tty *tty)
+{
+	const char	*s;
+
+	if (!(tty->flags & TTY_OPENED))
+		return;
+
+	if (tty->outlen != 0) {
+		tty_send(tty, tty->out, tty->outlen);
+		tty->outlen = 0;
+	}
+
+	if (tty->flags & TTY_SYNC) {
+		s = tty_term_string1(tty->term, TTYC_SYNC, 2);
+		bufferevent_write(tty->event, s, strlen(s));
+		tty->flags &= ~TTY_SYNC;
+		tty->frames++;
+	}
+}
+
+/*
+ * Add output to be sent at the next flush. A large redraw which fills the
+ * buffer is passed on in pieces as it goes.
+ */
+void
+tty_add(struct tty *tty, const void *buf, size_t len)
+{
+	if (tty->outlen + len > TTY_OUTSIZE) {
+		tty->outpassed++;
+		if (tty->outlen != 0) {
+			tty_send(tty, tty->out, tty->outlen);
+			tty->outlen = 0;
+		}
+		if (len > TTY_OUTSIZE) {
+			tty_send(tty, buf, len);
+			return;
+		}
+	}
+	memcpy(tty->out + tty->outlen, buf, len);
+	tty->outlen += len;
+}
+
+/*
+ * Stop sending updates to a terminal which has too much output waiting,
+ * rather than let it fall further behind.
+ */
+int
+tty_block_maybe(struct tty *tty)
+{
+	size_t	size;
+
+	if (tty->flags & TTY_BLOCK)
+		return (1);
+	if (!(tty->flags & TTY_OPENED))
+		return (0);
+
+	size = tty->outlen + EVBUFFER_LENGTH(tty->event->output);
+	if (size < TTY_BLOCK_START(tty))
+		return (0);
+	log_debug("%s blocked (%zu bytes)", tty->path, size);
+
+	tty->flags |= TTY_BLOCK;
+	bufferevent_setwatermark(tty->event, EV_WRITE, TTY_BLOCK_STOP(tty), 0);
+	return (1);
+}
+
 void
 tty_raw(struct tty *tty, const char *s)
 {
@@ -380,10 +543,7 @@ tty_puts(struct tty *tty, const char *s)
 {
 	if (*s == '\0')
 		return;
-	bufferevent_write(tty->event, s, strlen(s));
-
-	if (tty->log_fd != -1)
-		write(tty->log_fd, s, strlen(s));
+	tty_add(tty, s, strlen(s));
 }
 
 void
@@ -395,11 +555,13 @@ tty_putc(struct tty *tty, u_char ch)
 	if (tty->cell.attr & GRID_ATTR_CHARSET) {
 		acs = tty_acs_get(tty, ch);
 		if (acs != NULL)
-			bufferevent_write(tty->event, acs, strlen(acs));
+			tty_add(tty, acs, strlen(acs));
 		else
-			bufferevent_write(tty->event, &ch, 1);
-	} else
-		bufferevent_write(tty->event, &ch, 1);
+			tty_add(tty, &ch, 1);
+	} else if (tty->outlen != TTY_OUTSIZE)
+		tty->out[tty->outlen++] = ch;
+	else
+		tty_add(tty, &ch, 1);
 
 	if (ch >= 0x20 && ch != 0x7f) {
 		sx = tty->sx;
@@ -413,9 +575,13 @@ tty_putc(struct tty *tty, u_char ch)
 		} else
 			tty->cx++;
 	}
+}
 
-	if (tty->log_fd != -1)
-		write(tty->log_fd, &ch, 1);
+void
+tty_putn(struct tty *tty, const void *buf, size_t len, u_int width)
+{
+	tty_add(tty, buf, len);
+	tty->cx += width;
 }
 
 void
@@ -424,9 +590,7 @@ tty_pututf8(struct tty *tty, const struct grid_utf8 *gu)
 	size_t	size;
 
 	size = grid_utf8_size(gu);
-	bufferevent_write(tty->event, gu->data, size);
-	if (tty->log_fd != -1)
-		write(tty->log_fd, gu->data, size);
+	tty_add(tty, gu->data, size);
 	tty->cx += gu->width;
 }
 
@@ -532,8 +696,89 @@ tty_emulate_repeat(
 void
 tty_repeat_space(struct tty *tty, u_int n)
 {
+	tty_repeat_char(tty, ' ', n);
+}
+
+/*
+ * Write a character n times with the current attributes. Where it is shorter,
+ * blanks are erased with EL or ECH and anything else is repeated with REP.
+ * None of these go past the end of the line, so EL is only used if the
+ * characters would have reached the right edge of the terminal.
+ */
+void
+tty_repeat_char(struct tty *tty, u_char ch, u_int n)
+{
+	struct tty_term		*term = tty->term;
+	struct grid_cell	*tc = &tty->cell;
+	const char		*s;
+	u_int			 cx = tty->cx, cy = tty->cy, cost;
+	int			 how;
+
+	if (n < 4 || cx >= tty->sx || n > tty->sx - cx)
+		goto plain;
+
+	/*
+	 * Erasing is only the same as blanks with no attributes and either
+	 * the default background or a terminal which erases with the current
+	 * background (bce). The cursor doesn't move so may need to be moved
+	 * after.
+	 */
+	if (ch == ' ' && (tc->attr & ~GRID_ATTR_CHARSET) == 0 &&
+	    ((tc->bg == 8 && !(tc->flags & GRID_FLAG_BG256)) ||
+	    tty_term_flag(term, TTYC_BCE))) {
+		if (cx + n == tty->sx && tty_term_has(term, TTYC_EL)) {
+			tty_putcode(tty, TTYC_EL);
+			return;
+		}
+		if (tty_term_has(term, TTYC_ECH)) {
+			cost = tty_term_cost1(term, TTYC_ECH, n);
+			if (cx + n != tty->sx)
+				cost += tty_cursor_cost_x(tty, cx, cx + n, cy,
+				    &how);
+			if (cost < n) {
+				tty_putcode1(tty, TTYC_ECH, n);
+				if (cx + n != tty->sx)
+					tty_cursor(tty, cx + n, cy);
+				return;
+			}
+		}
+	}
+
+	/* Repeat leaves the cursor after, so it must not reach the edge. */
+	if (tty_term_has(term, TTYC_REP) && cx + n < tty->sx &&
+	    !(tc->attr & GRID_ATTR_CHARSET)) {
+		s = tty_term_string2(term, TTYC_REP, ch, n);
+		if (strlen(s) < n) {
+			tty_puts(tty, s);
+			tty->cx += n;
+			return;
+		}
+	}
+
+plain:
 	while (n-- > 0)
-		tty_putc(tty, ' ');
+		tty_putc(tty, ch);
+}
+
+/* Write a run of the same cell. */
+void
+tty_repeat_cell(struct tty *tty, const struct grid_cell *gc, u_int n)
+{
+	/*
+	 * Only plain ASCII can be repeated, and not to the bottom-right if
+	 * tty_cell would skip it.
+	 */
+	if (n < 4 || gc->flags & (GRID_FLAG_UTF8|GRID_FLAG_PADDING) ||
+	    gc->data < 0x20 || gc->data > 0x7e ||
+	    ((tty->term->flags & TERM_EARLYWRAP) &&
+	    tty->cy == tty->sy - 1 && tty->cx + n >= tty->sx)) {
+		while (n-- > 0)
+			tty_cell(tty, gc);
+		return;
+	}
+
+	tty_attributes(tty, gc);
+	tty_repeat_char(tty, gc->data, n);
 }
 
 /*
@@ -562,11 +807,11 @@ tty_redraw_region(struct tty *tty, const struct tty_ctx *ctx)
 	u_int		 	 i;
 
 	/*
-	 * If region is large, schedule a window redraw. In most cases this is
-	 * likely to be followed by some more scrolling.
+	 * If region is large, schedule a redraw of the changed lines. In most
+	 * cases this is likely to be followed by some more scrolling.
 	 */
 	if (tty_large_region(tty, ctx)) {
-		wp->flags |= PANE_REDRAW;
+		wp->flags |= PANE_CHANGED;
 		return;
 	}
 
@@ -584,15 +829,18 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int py, u_int ox, u_int oy)
 {
 	const struct grid_cell	*gc;
 	struct grid_line	*gl;
-	struct grid_cell	 tmpgc;
-	const struct grid_utf8	*gu;
-	u_int			 i, sx;
+	struct grid_cell	 tmpgc, rungc;
+	u_int			 i, n, sx;
+
+	/* Margins can stay set only if this is the pane they are around. */
+	if (ox != tty->rleft || ox + screen_size_x(s) - 1 != tty->rright)
+		tty_margin_off(tty);
 
 	tty_update_mode(tty, tty->mode & ~MODE_CURSOR, s);
 
 	sx = screen_size_x(s);
-	if (sx > s->grid->linedata[s->grid->hsize + py].cellsize)
-		sx = s->grid->linedata[s->grid->hsize + py].cellsize;
+	if (sx > grid_get_line(s->grid, s->grid->hsize + py)->cellsize)
+		sx = grid_get_line(s->grid, s->grid->hsize + py)->cellsize;
 	if (sx > tty->sx)
 		sx = tty->sx;
 
@@ -602,29 +850,23 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int py, u_int ox, u_int oy)
 	 */
 	gl = NULL;
 	if (py != 0)
-		gl = &s->grid->linedata[s->grid->hsize + py - 1];
+		gl = grid_get_line(s->grid, s->grid->hsize + py - 1);
 	if (oy + py == 0 || gl == NULL || !(gl->flags & GRID_LINE_WRAPPED) ||
 	    tty->cx < tty->sx || ox != 0 ||
 	    (oy + py != tty->cy + 1 && tty->cy != s->rlower + oy))
 		tty_cursor(tty, ox, oy + py);
 
-	for (i = 0; i < sx; i++) {
-		gc = grid_view_peek_cell(s->grid, i, py);
-
-		gu = NULL;
-		if (gc->flags & GRID_FLAG_UTF8)
-			gu = grid_view_peek_utf8(s->grid, i, py);
-
-		if (screen_check_selection(s, i, py)) {
-			memcpy(&tmpgc, &s->sel.cell, sizeof tmpgc);
-			tmpgc.data = gc->data;
-			tmpgc.flags = gc->flags &
-			    ~(GRID_FLAG_FG256|GRID_FLAG_BG256);
-			tmpgc.flags |= s->sel.cell.flags &
-			    (GRID_FLAG_FG256|GRID_FLAG_BG256);
-			tty_cell(tty, &tmpgc, gu);
-		} else
-			tty_cell(tty, gc, gu);
+	for (i = 0; i < sx; i += n) {
+		gc = tty_line_cell(s, i, py, &tmpgc);
+
+		/* Find how many of the same cell follow, to send together. */
+		memcpy(&rungc, gc, sizeof rungc);
+		for (n = 1; i + n < sx; n++) {
+			gc = tty_line_cell(s, i + n, py, &tmpgc);
+			if (memcmp(gc, &rungc, sizeof rungc) != 0)
+				break;
+		}
+		tty_repeat_cell(tty, &rungc, n);
 	}
 
 	if (sx >= tty->sx) {
@@ -642,39 +884,350 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int py, u_int ox, u_int oy)
 	tty_update_mode(tty, tty->mode, s);
 }
 
+/* Get a cell to draw, as the selection if it is selected. */
+const struct grid_cell *
+tty_line_cell(struct screen *s, u_int px, u_int py, struct grid_cell *tmpgc)
+{
+	const struct grid_cell	*gc;
+
+	gc = grid_view_peek_cell(s->grid, px, py);
+	if (!screen_check_selection(s, px, py))
+		return (gc);
+
+	memcpy(tmpgc, &s->sel.cell, sizeof *tmpgc);
+	tmpgc->data = gc->data;
+	tmpgc->flags = gc->flags & ~(GRID_FLAG_FG256|GRID_FLAG_BG256);
+	tmpgc->flags |= s->sel.cell.flags & (GRID_FLAG_FG256|GRID_FLAG_BG256);
+	return (tmpgc);
+}
+
+/*
+ * Turn render-mode diff on or off. The terminal is up to date when turning it
+ * off, so the frames can simply be thrown away.
+ */
+void
+tty_set_render(struct tty *tty, int diff)
+{
+	if (diff)
+		tty->flags |= TTY_DIFF;
+	else {
+		tty->flags &= ~TTY_DIFF;
+		tty_frame_free(tty);
+	}
+}
+
+/* Free the frame and shadow, for example when the terminal size changes. */
+void
+tty_frame_free(struct tty *tty)
+{
+	free(tty->frame);
+	tty->frame = NULL;
+	free(tty->shadow);
+	tty->shadow = NULL;
+}
+
+/* Get a blank frame to be filled in and drawn with tty_draw_frame. */
+struct grid_cell *
+tty_frame_start(struct tty *tty)
+{
+	u_int	i, n;
+
+	n = tty->sx * tty->sy;
+	if (tty->frame == NULL) {
+		tty->frame = xcalloc(n, sizeof *tty->frame);
+		tty->shadow = xcalloc(n, sizeof *tty->shadow);
+		tty_frame_invalidate(tty);
+	}
+	for (i = 0; i < n; i++)
+		memcpy(&tty->frame[i], &grid_default_cell, sizeof *tty->frame);
+	return (tty->frame);
+}
+
+/*
+ * Forget what the terminal shows, so the next frame is drawn in full. The
+ * invalid cell has every flag set, so it never matches a real cell.
+ */
+void
+tty_frame_invalidate(struct tty *tty)
+{
+	if (tty->shadow != NULL)
+		memset(tty->shadow, 0xff,
+		    tty->sx * tty->sy * sizeof *tty->shadow);
+}
+
+/* Draw the cells of the frame which differ from the shadow. */
+void
+tty_draw_frame(struct tty *tty, struct screen *s)
+{
+	struct grid_cell	*want, *have;
+	u_int			 x, y, blank;
+	int			 flags;
+
+	if (tty->frame == NULL)
+		return;
+
+	tty_margin_off(tty);
+	tty_update_mode(tty, tty->mode & ~MODE_CURSOR, s);
+
+	for (y = 0; y < tty->sy; y++) {
+		want = &tty->frame[y * tty->sx];
+		have = &tty->shadow[y * tty->sx];
+
+		/*
+		 * Writing over either half of a wide character loses the other
+		 * half, and the padding half can only be drawn with the first.
+		 */
+		for (x = 0; x < tty->sx; x++) {
+			if (memcmp(&want[x], &have[x], sizeof *want) == 0)
+				continue;
+			flags = have[x].flags &
+			    (GRID_FLAG_PADDING|GRID_FLAG_WIDE);
+			if (flags == GRID_FLAG_PADDING && x > 0)
+				memset(&have[x - 1], 0xff, sizeof *have);
+			if (flags == GRID_FLAG_WIDE && x < tty->sx - 1)
+				memset(&have[x + 1], 0xff, sizeof *have);
+			if (want[x].flags & GRID_FLAG_PADDING && x > 0)
+				memset(&have[x - 1], 0xff, sizeof *have);
+		}
+
+		/* Find where the blank end of the line starts. */
+		blank = tty->sx;
+		while (blank > 0 && memcmp(&want[blank - 1],
+		    &grid_default_cell, sizeof *want) == 0)
+			blank--;
+		if (!tty_term_has(tty->term, TTYC_EL))
+			blank = tty->sx;
+
+		for (x = 0; x < tty->sx; x++) {
+			if (memcmp(&want[x], &have[x], sizeof *want) == 0)
+				continue;
+			if (want[x].flags & GRID_FLAG_PADDING)
+				continue;
+
+			if (x >= blank) {
+				tty_reset(tty);
+				tty_cursor(tty, x, y);
+				tty_putcode(tty, TTYC_EL);
+				for (; x < tty->sx; x++) {
+					memcpy(&have[x], &want[x],
+					    sizeof *have);
+				}
+				break;
+			}
+
+			tty_cursor(tty, x, y);
+			tty_cell(tty, &want[x]);
+			memcpy(&have[x], &want[x], sizeof *have);
+			if (want[x].flags & GRID_FLAG_WIDE && x < tty->sx - 1) {
+				x++;
+				memcpy(&have[x], &want[x], sizeof *have);
+			}
+		}
+	}
+
+	tty_reset(tty);
+	tty_update_mode(tty, tty->mode, s);
+}
+
+/* Save the parts of the state of a terminal compared by tty_same. */
+void
+tty_save_state(struct tty *tty, struct tty_state *ts)
+{
+	ts->term = tty->term;
+	ts->term_flags = tty->term_flags;
+	ts->flags = tty->flags & ~TTY_SYNC;
+
+	ts->sx = tty->sx;
+	ts->sy = tty->sy;
+	ts->cx = tty->cx;
+	ts->cy = tty->cy;
+
+	ts->rupper = tty->rupper;
+	ts->rlower = tty->rlower;
+	ts->rleft = tty->rleft;
+	ts->rright = tty->rright;
+
+	ts->mode = tty->mode;
+	ts->cstyle = tty->cstyle;
+	ts->ccolour = tty->ccolour;
+
+	memcpy(&ts->cell, &tty->cell, sizeof ts->cell);
+}
+
+/*
+ * Check if a terminal is in a saved state, so any command will produce the
+ * same output and leave it in the same state as the terminal saved.
+ */
+int
+tty_same(struct tty *tty, struct tty_state *ts)
+{
+	if (tty->term != ts->term || tty->term_flags != ts->term_flags)
+		return (0);
+	if ((tty->flags & ~TTY_SYNC) != ts->flags)
+		return (0);
+	if (tty->sx != ts->sx || tty->sy != ts->sy)
+		return (0);
+	if (tty->cx != ts->cx || tty->cy != ts->cy)
+		return (0);
+	if (tty->rupper != ts->rupper || tty->rlower != ts->rlower)
+		return (0);
+	if (tty->rleft != ts->rleft || tty->rright != ts->rright)
+		return (0);
+	if (tty->mode != ts->mode || tty->cstyle != ts->cstyle)
+		return (0);
+	if (strcmp(tty->ccolour, ts->ccolour) != 0)
+		return (0);
+	return (memcmp(&tty->cell, &ts->cell, sizeof tty->cell) == 0);
+}
+
+/*
+ * Before drawing to a terminal, check if it is in the same state as the last
+ * one drawn with this share and if so give it a copy of that output and the
+ * state it left. Otherwise, remember the state so the caller can draw and then
+ * call tty_share_end. The offset is where the output starts on the terminal,
+ * which depends on the status line.
+ */
+int
+tty_share_start(struct tty_share *share, struct tty *tty, u_int yoff)
+{
+	struct tty	*lead = share->lead;
+
+	if (lead != NULL && share->yoff == yoff &&
+	    tty_same(tty, &share->before)) {
+		tty_add(tty, lead->out + share->start,
+		    lead->outlen - share->start);
+
+		tty->cx = lead->cx;
+		tty->cy = lead->cy;
+		tty->rupper = lead->rupper;
+		tty->rlower = lead->rlower;
+		tty->rleft = lead->rleft;
+		tty->rright = lead->rright;
+		tty->mode = lead->mode;
+		tty->cstyle = lead->cstyle;
+		if (strcmp(tty->ccolour, lead->ccolour) != 0) {
+			free(tty->ccolour);
+			tty->ccolour = xstrdup(lead->ccolour);
+		}
+		memcpy(&tty->cell, &lead->cell, sizeof tty->cell);
+		tty->flags &= TTY_SYNC;
+		tty->flags |= lead->flags & ~TTY_SYNC;
+		return (1);
+	}
+
+	tty_save_state(tty, &share->before);
+	share->start = tty->outlen;
+	share->passed = tty->outpassed;
+	share->yoff = yoff;
+	return (0);
+}
+
+/*
+ * After drawing, make the terminal the one to copy from, unless its output was
+ * passed on while drawing and is no longer all in the buffer, or its cursor
+ * colour was changed, which frees the saved colour.
+ */
+void
+tty_share_end(struct tty_share *share, struct tty *tty)
+{
+	if (tty->outpassed == share->passed &&
+	    tty->ccolour == share->before.ccolour)
+		share->lead = tty;
+	else
+		share->lead = NULL;
+}
+
 void
 tty_write(
     void (*cmdfn)(struct tty *, const struct tty_ctx *), struct tty_ctx *ctx)
 {
 	struct window_pane	*wp = ctx->wp;
+	struct window		*w;
 	struct client		*c;
+	struct tty		*tty;
+	struct tty_share	 share;
 	u_int		 	 i;
+	int			 grid;
 
 	/* wp can be NULL if updating the screen but not the terminal. */
 	if (wp == NULL)
 		return;
+	w = wp->window;
+
+	/*
+	 * The selection and raw strings are not kept in the grid, so clients
+	 * drawing frames from it must still be sent them directly.
+	 */
+	grid = (cmdfn != tty_cmd_setselection && cmdfn != tty_cmd_rawstring);
 
-	if (wp->window->flags & WINDOW_REDRAW || wp->flags & PANE_REDRAW)
+	/*
+	 * If the pane is going to be redrawn or output is being dropped, leave
+	 * the changed lines marked in the screen for the redraw to pick up.
+	 * Only a full redraw loses what is not in the grid.
+	 */
+	if (w->flags & WINDOW_REDRAW)
+		return;
+	if (wp->flags & (PANE_REDRAW|PANE_DROP))
 		return;
-	if (!window_pane_visible(wp) || wp->flags & PANE_DROP)
+	if (grid && wp->flags & PANE_CHANGED)
+		return;
+	if (!window_pane_visible(wp))
 		return;
 
-	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
-		c = ARRAY_ITEM(&clients, i);
-		if (c == NULL || c->session == NULL || c->tty.term == NULL)
+	share.lead = NULL;
+	for (i = 0; i < ARRAY_LENGTH(&w->clients); i++) {
+		c = ARRAY_ITEM(&w->clients, i);
+		if (c->flags & CLIENT_DEAD)
+			continue;
+		if (c->session == NULL || c->tty.term == NULL)
 			continue;
 		if (c->flags & (CLIENT_SUSPENDED|TTY_FREEZE))
 			continue;
-		if (c->session->curw->window != wp->window)
+		if (c->session->curw->window != w)
 			continue;
+		if (tty_block_maybe(&c->tty)) {
+			c->tty.dropped++;
+			continue;
+		}
+		tty = &c->tty;
+		if (tty->flags & TTY_DIFF) {
+			c->flags |= CLIENT_FRAME;
+			if (grid)
+				continue;
+		}
 
 		ctx->xoff = wp->xoff;
 		ctx->yoff = wp->yoff;
 		if (status_at_line(c) == 0)
 			ctx->yoff++;
 
-		cmdfn(&c->tty, ctx);
+		/*
+		 * Clients in the same state as the last one drawn, such as
+		 * several attached to one session with the same size and
+		 * terminal, are given a copy of its output rather than running
+		 * the command again.
+		 */
+		if (!tty_share_start(&share, tty, ctx->yoff)) {
+			/*
+			 * Margins can only stay set for more output to the
+			 * same pane.
+			 */
+			if (tty->rleft != ctx->xoff ||
+			    tty->rright != ctx->xoff + wp->sx - 1)
+				tty_margin_off(tty);
+
+			cmdfn(tty, ctx);
+			tty_share_end(&share, tty);
+		}
+
+		/* A raw string may have changed anything on the terminal. */
+		if (tty->flags & TTY_DIFF && cmdfn == tty_cmd_rawstring)
+			tty_frame_invalidate(tty);
 	}
+
+	/* Clients are now up to date unless a redraw was scheduled. */
+	if (!(wp->flags & (PANE_REDRAW|PANE_CHANGED)))
+		screen_clear_dirty(wp->screen);
 }
 
 void
@@ -722,7 +1275,7 @@ tty_cmd_deletecharacter(struct tty *tty, const struct tty_ctx *ctx)
 void
 tty_cmd_insertline(struct tty *tty, const struct tty_ctx *ctx)
 {
-	if (!tty_pane_full_width(tty, ctx) ||
+	if ((!tty_pane_full_width(tty, ctx) && !tty_use_margin(tty)) ||
 	    !tty_term_has(tty->term, TTYC_CSR) ||
 	    !tty_term_has(tty->term, TTYC_IL1)) {
 		tty_redraw_region(tty, ctx);
@@ -732,6 +1285,7 @@ tty_cmd_insertline(struct tty *tty, const struct tty_ctx *ctx)
 	tty_reset(tty);
 
 	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
+	tty_margin_pane(tty, ctx);
 	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->ocy);
 
 	tty_emulate_repeat(tty, TTYC_IL, TTYC_IL1, ctx->num);
@@ -740,7 +1294,7 @@ tty_cmd_insertline(struct tty *tty, const struct tty_ctx *ctx)
 void
 tty_cmd_deleteline(struct tty *tty, const struct tty_ctx *ctx)
 {
-	if (!tty_pane_full_width(tty, ctx) ||
+	if ((!tty_pane_full_width(tty, ctx) && !tty_use_margin(tty)) ||
 	    !tty_term_has(tty->term, TTYC_CSR) ||
 	    !tty_term_has(tty->term, TTYC_DL1)) {
 		tty_redraw_region(tty, ctx);
@@ -750,6 +1304,7 @@ tty_cmd_deleteline(struct tty *tty, const struct tty_ctx *ctx)
 	tty_reset(tty);
 
 	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
+	tty_margin_pane(tty, ctx);
 	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->ocy);
 
 	tty_emulate_repeat(tty, TTYC_DL, TTYC_DL1, ctx->num);
@@ -807,7 +1362,7 @@ tty_cmd_reverseindex(struct tty *tty, const struct tty_ctx *ctx)
 	if (ctx->ocy != ctx->orupper)
 		return;
 
-	if (!tty_pane_full_width(tty, ctx) ||
+	if ((!tty_pane_full_width(tty, ctx) && !tty_use_margin(tty)) ||
 	    !tty_term_has(tty->term, TTYC_CSR) ||
 	    !tty_term_has(tty->term, TTYC_RI)) {
 		tty_redraw_region(tty, ctx);
@@ -817,7 +1372,8 @@ tty_cmd_reverseindex(struct tty *tty, const struct tty_ctx *ctx)
 	tty_reset(tty);
 
 	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
-	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->orupper);
+	tty_margin_pane(tty, ctx);
+	tty_cursor_pane(tty, ctx, tty_margin_cx(tty, ctx), ctx->orupper);
 
 	tty_putcode(tty, TTYC_RI);
 }
@@ -830,10 +1386,10 @@ tty_cmd_linefeed(struct tty *tty, const struct tty_ctx *ctx)
 	if (ctx->ocy != ctx->orlower)
 		return;
 
-	if (!tty_pane_full_width(tty, ctx) ||
+	if ((!tty_pane_full_width(tty, ctx) && !tty_use_margin(tty)) ||
 	    !tty_term_has(tty->term, TTYC_CSR)) {
 		if (tty_large_region(tty, ctx))
-			wp->flags |= PANE_REDRAW;
+			wp->flags |= PANE_CHANGED;
 		else
 			tty_redraw_region(tty, ctx);
 		return;
@@ -842,15 +1398,30 @@ tty_cmd_linefeed(struct tty *tty, const struct tty_ctx *ctx)
 	/*
 	 * If this line wrapped naturally (ctx->num is nonzero), don't do
 	 * anything - the cursor can just be moved to the last cell and wrap
-	 * naturally.
+	 * naturally. The terminal only wraps at its own right edge, so this is
+	 * only done if the pane is full width.
+	 */
+	if (ctx->num && !(tty->term->flags & TERM_EARLYWRAP) &&
+	    tty_pane_full_width(tty, ctx))
+		return;
+
+	/*
+	 * Each line scrolled with margins is drawn in full; once more than a
+	 * pane of output has gone past in this loop, redrawing it once at the
+	 * end is cheaper. The lines are counted as they are scrolled, not for
+	 * each client.
 	 */
-	if (ctx->num && !(tty->term->flags & TERM_EARLYWRAP))
+	if (!tty_pane_full_width(tty, ctx) &&
+	    wp->scrolled > screen_size_y(wp->screen)) {
+		wp->flags |= PANE_CHANGED;
 		return;
+	}
 
 	tty_reset(tty);
 
 	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
-	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->ocy);
+	tty_margin_pane(tty, ctx);
+	tty_cursor_pane(tty, ctx, tty_margin_cx(tty, ctx), ctx->ocy);
 
 	tty_putc(tty, '\n');
 }
@@ -969,12 +1540,8 @@ tty_cmd_cell(struct tty *tty, const struct tty_ctx *ctx)
 	u_int			 cx;
 	u_int			 width;
 	const struct grid_cell	*gc = ctx->cell;
-	const struct grid_utf8	*gu = ctx->utf8;
 
-	if (gc->flags & GRID_FLAG_UTF8)
-		width = gu->width;
-	else
-		width = 1;
+	width = grid_cell_width(gc);
 
 	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
 
@@ -995,17 +1562,41 @@ tty_cmd_cell(struct tty *tty, const struct tty_ctx *ctx)
 			 * move as far left as possible and redraw the last
 			 * cell to move into the last position.
 			 */
-			if (ctx->last_cell.flags & GRID_FLAG_UTF8)
-				cx = screen_size_x(s) - ctx->last_utf8.width;
-			else
-				cx = screen_size_x(s) - 1;
+			cx = screen_size_x(s);
+			cx -= grid_cell_width(&ctx->last_cell);
 			tty_cursor_pane(tty, ctx, cx, ctx->ocy);
-			tty_cell(tty, &ctx->last_cell, &ctx->last_utf8);
+			tty_cell(tty, &ctx->last_cell);
 		}
 	} else
 		tty_cursor_pane(tty, ctx, ctx->ocx, ctx->ocy);
 
-	tty_cell(tty, ctx->cell, ctx->utf8);
+	tty_cell(tty, ctx->cell);
+}
+
+void
+tty_cmd_cells(struct tty *tty, const struct tty_ctx *ctx)
+{
+	struct grid_cell	 gc;
+	const u_char		*ptr = ctx->ptr;
+	u_int			 i;
+
+	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
+	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->ocy);
+
+	/*
+	 * The run never passes the end of the pane, so unless ACS translation
+	 * or early wrap is involved it can be written directly.
+	 */
+	tty_attributes(tty, ctx->cell);
+	if (tty->cell.attr & GRID_ATTR_CHARSET ||
+	    tty->term->flags & TERM_EARLYWRAP) {
+		memcpy(&gc, ctx->cell, sizeof gc);
+		for (i = 0; i < ctx->num; i++) {
+			gc.data = ptr[i];
+			tty_cell(tty, &gc);
+		}
+	} else
+		tty_putn(tty, ptr, ctx->num, ctx->num);
 }
 
 void
@@ -1044,6 +1635,7 @@ tty_cmd_rawstring(struct tty *tty, const struct tty_ctx *ctx)
 	u_int	 i;
 	u_char	*str = ctx->ptr;
 
+	tty_margin_off(tty);
 	for (i = 0; i < ctx->num; i++)
 		tty_putc(tty, str[i]);
 
@@ -1055,10 +1647,10 @@ tty_cmd_rawstring(struct tty *tty, const struct tty_ctx *ctx)
 }
 
 void
-tty_cell(
-    struct tty *tty, const struct grid_cell *gc, const struct grid_utf8 *gu)
+tty_cell(struct tty *tty, const struct grid_cell *gc)
 {
-	u_int	i;
+	struct grid_utf8	gu;
+	u_int			i;
 
 	/* Skip last character if terminal is stupid. */
 	if (tty->term->flags & TERM_EARLYWRAP &&
@@ -1082,13 +1674,14 @@ tty_cell(
 
 	/* If the terminal doesn't support UTF-8, write underscores. */
 	if (!(tty->flags & TTY_UTF8)) {
-		for (i = 0; i < gu->width; i++)
+		for (i = 0; i < grid_cell_width(gc); i++)
 			tty_putc(tty, '_');
 		return;
 	}
 
 	/* Otherwise, write UTF-8. */
-	tty_pututf8(tty, gu);
+	grid_utf8_get(gc, &gu);
+	tty_pututf8(tty, &gu);
 }
 
 void
@@ -1105,6 +1698,70 @@ tty_reset(struct tty *tty)
 	memcpy(gc, &grid_default_cell, sizeof *gc);
 }
 
+/*
+ * Set the left and right margins around a pane which is not full width, so it
+ * can be scrolled without affecting the panes beside it.
+ */
+void
+tty_margin_pane(struct tty *tty, const struct tty_ctx *ctx)
+{
+	if (tty_pane_full_width(tty, ctx))
+		return;
+	tty_margin(tty,
+	    ctx->xoff, ctx->xoff + screen_size_x(ctx->wp->screen) - 1);
+}
+
+/*
+ * Set left and right margins. Margins are left set only while output is for
+ * the same pane, anything else must call tty_margin_off first.
+ */
+void
+tty_margin(struct tty *tty, u_int rleft, u_int rright)
+{
+	if (tty->rleft == rleft && tty->rright == rright)
+		return;
+	if (!tty_use_margin(tty))
+		return;
+
+	if (tty->rleft == UINT_MAX)
+		tty_putcode(tty, TTYC_ENMG);
+	tty->rleft = rleft;
+	tty->rright = rright;
+
+	/* As for tty_region, move to 0 first if beyond the last column. */
+	if (tty->cx >= tty->sx && tty->cy < tty->sy)
+		tty_cursor(tty, 0, tty->cy);
+
+	/* This moves the cursor home, so the position is now unknown. */
+	tty_putcode2(tty, TTYC_SMGLR, rleft, rright);
+	tty->cx = tty->cy = UINT_MAX;
+}
+
+/*
+ * Column in the pane to scroll from. A pane which has just filled its last
+ * line leaves the cursor one past its right edge; with margins set that is
+ * outside them and the terminal will not scroll, so use the last column.
+ */
+u_int
+tty_margin_cx(struct tty *tty, const struct tty_ctx *ctx)
+{
+	u_int	sx = screen_size_x(ctx->wp->screen);
+
+	if (!tty_pane_full_width(tty, ctx) && ctx->ocx > sx - 1)
+		return (sx - 1);
+	return (ctx->ocx);
+}
+
+/* Turn margins off, which also resets them to the whole line. */
+void
+tty_margin_off(struct tty *tty)
+{
+	if (tty->rleft == UINT_MAX)
+		return;
+	tty_putcode(tty, TTYC_DSMG);
+	tty->rleft = tty->rright = UINT_MAX;
+}
+
 /* Set region inside pane. */
 void
 tty_region_pane(
@@ -1145,129 +1802,283 @@ tty_cursor_pane(struct tty *tty, const struct tty_ctx *ctx, u_int cx, u_int cy)
 	tty_cursor(tty, ctx->xoff + cx, ctx->yoff + cy);
 }
 
-/* Move cursor to absolute position. */
-void
-tty_cursor(struct tty *tty, u_int cx, u_int cy)
+/*
+ * Cost in bytes of moving the cursor to a new row, and how to do it, or
+ * UINT_MAX if it can't be done without moving the column.
+ */
+u_int
+tty_cursor_cost_y(struct tty *tty, u_int cy, int *how)
 {
 	struct tty_term	*term = tty->term;
-	u_int		 thisx, thisy;
-	int		 change;
+	u_int		 thisy = tty->cy, n, cost, best;
 
-	if (cx > tty->sx - 1)
-		cx = tty->sx - 1;
+	*how = TTY_MOVE_NONE;
+	if (cy == thisy)
+		return (0);
 
-	thisx = tty->cx;
-	thisy = tty->cy;
+	best = UINT_MAX;
+	if (tty_term_has(term, TTYC_VPA)) {
+		best = tty_term_cost1(term, TTYC_VPA, cy + 1);
+		*how = TTY_MOVE_ABSOLUTE;
+	}
 
-	/* No change. */
-	if (cx == thisx && cy == thisy)
-		return;
+	/* Relative movement stops at the scroll region, so can't cross it. */
+	if (cy > thisy) {
+		if (thisy <= tty->rlower && cy > tty->rlower)
+			return (best);
+		n = cy - thisy;
+		if (n < best) {
+			best = n;
+			*how = TTY_MOVE_LINEFEED;
+		}
+		cost = n * tty_term_cost(term, TTYC_CUD1);
+		if (tty_term_has(term, TTYC_CUD1) && cost < best) {
+			best = cost;
+			*how = TTY_MOVE_ONE;
+		}
+		cost = tty_term_cost1(term, TTYC_CUD, n);
+		if (tty_term_has(term, TTYC_CUD) && cost < best) {
+			best = cost;
+			*how = TTY_MOVE_MANY;
+		}
+	} else {
+		if (thisy >= tty->rupper && cy < tty->rupper)
+			return (best);
+		n = thisy - cy;
+		cost = n * tty_term_cost(term, TTYC_CUU1);
+		if (tty_term_has(term, TTYC_CUU1) && cost < best) {
+			best = cost;
+			*how = TTY_MOVE_ONE;
+		}
+		cost = tty_term_cost1(term, TTYC_CUU, n);
+		if (tty_term_has(term, TTYC_CUU) && cost < best) {
+			best = cost;
+			*how = TTY_MOVE_MANY;
+		}
+	}
+	return (best);
+}
 
-	/* Very end of the line, just use absolute movement. */
-	if (thisx > tty->sx - 1)
-		goto absolute;
+/*
+ * Cost in bytes of moving the cursor to a new column on row cy, and how to do
+ * it, or UINT_MAX if it can't be done.
+ */
+u_int
+tty_cursor_cost_x(struct tty *tty, u_int thisx, u_int cx, u_int cy, int *how)
+{
+	struct tty_term	*term = tty->term;
+	u_int		 n, cost, best;
 
-	/* Move to home position (0, 0). */
-	if (cx == 0 && cy == 0 && tty_term_has(term, TTYC_HOME)) {
-		tty_putcode(tty, TTYC_HOME);
-		goto out;
+	*how = TTY_MOVE_NONE;
+	if (cx == thisx)
+		return (0);
+
+	best = UINT_MAX;
+	if (tty_term_has(term, TTYC_HPA)) {
+		best = tty_term_cost1(term, TTYC_HPA, cx + 1);
+		*how = TTY_MOVE_ABSOLUTE;
 	}
 
-	/* Zero on the next line. */
-	if (cx == 0 && cy == thisy + 1 && thisy != tty->rlower) {
-		tty_putc(tty, '\r');
-		tty_putc(tty, '\n');
-		goto out;
+	if (cx < thisx) {
+		n = thisx - cx;
+		cost = n * tty_term_cost(term, TTYC_CUB1);
+		if (tty_term_has(term, TTYC_CUB1) && cost < best) {
+			best = cost;
+			*how = TTY_MOVE_ONE;
+		}
+		cost = tty_term_cost1(term, TTYC_CUB, n);
+		if (tty_term_has(term, TTYC_CUB) && cost < best) {
+			best = cost;
+			*how = TTY_MOVE_MANY;
+		}
+	} else {
+		n = cx - thisx;
+		if (n < best && tty_cursor_cells(tty, thisx, cx, cy)) {
+			best = n;
+			*how = TTY_MOVE_CELLS;
+		}
+		cost = n * tty_term_cost(term, TTYC_CUF1);
+		if (tty_term_has(term, TTYC_CUF1) && cost < best) {
+			best = cost;
+			*how = TTY_MOVE_ONE;
+		}
+		cost = tty_term_cost1(term, TTYC_CUF, n);
+		if (tty_term_has(term, TTYC_CUF) && cost < best) {
+			best = cost;
+			*how = TTY_MOVE_MANY;
+		}
 	}
+	return (best);
+}
 
-	/* Moving column or row. */
-	if (cy == thisy) {
-		/*
-		 * Moving column only, row staying the same.
-		 */
+/*
+ * Check if the cursor can be moved right by writing the cells the terminal
+ * already shows. This is only known when drawing with render-mode diff and
+ * the cells must be plain ASCII with the current attributes.
+ */
+int
+tty_cursor_cells(struct tty *tty, u_int thisx, u_int cx, u_int cy)
+{
+	struct grid_cell	*gc, *tc = &tty->cell;
+	u_int			 x;
 
-		/* To left edge. */
-		if (cx == 0)	{
-			tty_putc(tty, '\r');
-			goto out;
-		}
+	if (tty->shadow == NULL)
+		return (0);
+	for (x = thisx; x < cx; x++) {
+		gc = &tty->shadow[cy * tty->sx + x];
+		if (gc->flags & ~(GRID_FLAG_FG256|GRID_FLAG_BG256))
+			return (0);
+		if (gc->data < 0x20 || gc->data > 0x7e)
+			return (0);
+		if (gc->attr != tc->attr || gc->fg != tc->fg ||
+		    gc->bg != tc->bg || gc->flags != (tc->flags &
+		    (GRID_FLAG_FG256|GRID_FLAG_BG256)))
+			return (0);
+	}
+	return (1);
+}
 
-		/* One to the left. */
-		if (cx == thisx - 1 && tty_term_has(term, TTYC_CUB1)) {
-			tty_putcode(tty, TTYC_CUB1);
-			goto out;
+/* Move the cursor to a new row as chosen by tty_cursor_cost_y. */
+void
+tty_cursor_move_y(struct tty *tty, u_int cy, int how)
+{
+	u_int	thisy = tty->cy, n;
+
+	switch (how) {
+	case TTY_MOVE_ABSOLUTE:
+		tty_putcode1(tty, TTYC_VPA, cy);
+		break;
+	case TTY_MOVE_LINEFEED:
+		for (n = cy - thisy; n > 0; n--)
+			tty_putc(tty, '\n');
+		break;
+	case TTY_MOVE_ONE:
+		if (cy > thisy) {
+			for (n = cy - thisy; n > 0; n--)
+				tty_putcode(tty, TTYC_CUD1);
+		} else {
+			for (n = thisy - cy; n > 0; n--)
+				tty_putcode(tty, TTYC_CUU1);
 		}
+		break;
+	case TTY_MOVE_MANY:
+		if (cy > thisy)
+			tty_putcode1(tty, TTYC_CUD, cy - thisy);
+		else
+			tty_putcode1(tty, TTYC_CUU, thisy - cy);
+		break;
+	}
+}
 
-		/* One to the right. */
-		if (cx == thisx + 1 && tty_term_has(term, TTYC_CUF1)) {
-			tty_putcode(tty, TTYC_CUF1);
-			goto out;
+/* Move the cursor to a new column as chosen by tty_cursor_cost_x. */
+void
+tty_cursor_move_x(struct tty *tty, u_int thisx, u_int cx, u_int cy, int how)
+{
+	u_int	n, x;
+
+	switch (how) {
+	case TTY_MOVE_ABSOLUTE:
+		tty_putcode1(tty, TTYC_HPA, cx);
+		break;
+	case TTY_MOVE_CELLS:
+		for (x = thisx; x < cx; x++)
+			tty_putc(tty, tty->shadow[cy * tty->sx + x].data);
+		break;
+	case TTY_MOVE_ONE:
+		if (cx > thisx) {
+			for (n = cx - thisx; n > 0; n--)
+				tty_putcode(tty, TTYC_CUF1);
+		} else {
+			for (n = thisx - cx; n > 0; n--)
+				tty_putcode(tty, TTYC_CUB1);
 		}
+		break;
+	case TTY_MOVE_MANY:
+		if (cx > thisx)
+			tty_putcode1(tty, TTYC_CUF, cx - thisx);
+		else
+			tty_putcode1(tty, TTYC_CUB, thisx - cx);
+		break;
+	}
+}
 
-		/* Calculate difference. */
-		change = thisx - cx;	/* +ve left, -ve right */
+/*
+ * Move cursor to absolute position. Each way of getting there is costed in
+ * bytes and the cheapest used: absolute movement, or a move up or down
+ * combined with one left or right, from the current column or after a
+ * carriage return.
+ */
+void
+tty_cursor(struct tty *tty, u_int cx, u_int cy)
+{
+	struct tty_term	*term = tty->term;
+	u_int		 thisx, thisy, best, ycost, xcost;
+	int		 yhow, xhow, how, cr;
 
-		/*
-		 * Use HPA if change is larger than absolute, otherwise move
-		 * the cursor with CUB/CUF.
-		 */
-		if ((u_int) abs(change) > cx && tty_term_has(term, TTYC_HPA)) {
-			tty_putcode1(tty, TTYC_HPA, cx);
-			goto out;
-		} else if (change > 0 && tty_term_has(term, TTYC_CUB)) {
-			tty_putcode1(tty, TTYC_CUB, change);
-			goto out;
-		} else if (change < 0 && tty_term_has(term, TTYC_CUF)) {
-			tty_putcode1(tty, TTYC_CUF, -change);
-			goto out;
-		}
-	} else if (cx == thisx) {
-		/*
-		 * Moving row only, column staying the same.
-		 */
+	if (cx > tty->sx - 1)
+		cx = tty->sx - 1;
 
-		/* One above. */
-		if (thisy != tty->rupper &&
-		    cy == thisy - 1 && tty_term_has(term, TTYC_CUU1)) {
-			tty_putcode(tty, TTYC_CUU1);
-			goto out;
-		}
+	thisx = tty->cx;
+	thisy = tty->cy;
 
-		/* One below. */
-		if (thisy != tty->rlower &&
-		    cy == thisy + 1 && tty_term_has(term, TTYC_CUD1)) {
-			tty_putcode(tty, TTYC_CUD1);
-			goto out;
-		}
+	/* No change. */
+	if (cx == thisx && cy == thisy)
+		return;
 
-		/* Calculate difference. */
-		change = thisy - cy;	/* +ve up, -ve down */
+	/* Absolute movement always works, so start with that. */
+	best = tty_term_cost2(term, TTYC_CUP, cy + 1, cx + 1);
+	cr = -1;
+	yhow = xhow = TTY_MOVE_NONE;
 
-		/*
-		 * Try to use VPA if change is larger than absolute or if this
-		 * change would cross the scroll region, otherwise use CUU/CUD.
-		 */
-		if ((u_int) abs(change) > cy ||
-		    (change < 0 && cy - change > tty->rlower) ||
-		    (change > 0 && cy - change < tty->rupper)) {
-			    if (tty_term_has(term, TTYC_VPA)) {
-				    tty_putcode1(tty, TTYC_VPA, cy);
-				    goto out;
-			    }
-		} else if (change > 0 && tty_term_has(term, TTYC_CUU)) {
-			tty_putcode1(tty, TTYC_CUU, change);
-			goto out;
-		} else if (change < 0 && tty_term_has(term, TTYC_CUD)) {
-			tty_putcode1(tty, TTYC_CUD, -change);
-			goto out;
+	/*
+	 * If the position is not known, nothing else can be used. At the very
+	 * end of the line the terminal is waiting to wrap, so only a carriage
+	 * return is safe to start with.
+	 */
+	if (thisy > tty->sy - 1 || thisx > tty->sx)
+		goto out;
+
+	/*
+	 * Carriage return and relative movement stop at the margins, so only
+	 * absolute movement is safe while they are set.
+	 */
+	if (tty->rleft != UINT_MAX)
+		goto out;
+
+	ycost = tty_cursor_cost_y(tty, cy, &yhow);
+	if (ycost == UINT_MAX)
+		goto out;
+	if (thisx < tty->sx) {
+		xcost = tty_cursor_cost_x(tty, thisx, cx, cy, &how);
+		if (xcost != UINT_MAX && ycost + xcost < best) {
+			best = ycost + xcost;
+			xhow = how;
+			cr = 0;
 		}
 	}
-
-absolute:
-	/* Absolute movement. */
-	tty_putcode2(tty, TTYC_CUP, cy, cx);
+	xcost = tty_cursor_cost_x(tty, 0, cx, cy, &how);
+	if (xcost != UINT_MAX && 1 + ycost + xcost < best) {
+		best = 1 + ycost + xcost;
+		xhow = how;
+		cr = 1;
+	}
 
 out:
+	/* Move to home position (0, 0). */
+	if (cx == 0 && cy == 0 && tty_term_has(term, TTYC_HOME) &&
+	    tty_term_cost(term, TTYC_HOME) < best)
+		tty_putcode(tty, TTYC_HOME);
+	else if (cr == -1)
+		tty_putcode2(tty, TTYC_CUP, cy, cx);
+	else {
+		if (cr) {
+			tty_putc(tty, '\r');
+			thisx = 0;
+		}
+		tty_cursor_move_y(tty, cy, yhow);
+		tty_cursor_move_x(tty, thisx, cx, cy, xhow);
+	}
+
 	tty->cx = cx;
 	tty->cy = cy;
 }
@@ -1299,6 +2110,12 @@ tty_attributes(struct tty *tty, const struct grid_cell *gc)
 	tty_check_fg(tty, &gc2);
 	tty_check_bg(tty, &gc2);
 
+	/* If the terminal allows, send everything as one sequence. */
+	if (tty->term->flags & TERM_SGR) {
+		tty_attributes_sgr(tty, &gc2);
+		return;
+	}
+
 	/* If any bits are being cleared, reset everything. */
 	if (tc->attr & ~gc2.attr)
 		tty_reset(tty);
@@ -1341,6 +2158,175 @@ tty_attributes(struct tty *tty, const struct grid_cell *gc)
 		tty_putcode(tty, TTYC_SMACS);
 }
 
+/*
+ * Change attributes and colours with a single SGR sequence, either with
+ * parameters for only what has changed or starting with a reset, whichever is
+ * shorter.
+ */
+void
+tty_attributes_sgr(struct tty *tty, const struct grid_cell *gc)
+{
+	struct tty_term		*term = tty->term;
+	struct grid_cell	*tc = &tty->cell;
+	char			 delta[64], reset[64], s[80];
+	u_char			 codes, attr, cleared, added;
+	int			 fg_changed, bg_changed, fg_default, bg_default;
+	int			 use_delta, have_ax;
+	u_int			 i, j;
+
+	/* Attributes without a code were never sent so can be ignored. */
+	codes = 0;
+	for (i = 0; i < nitems(term->sgr); i++) {
+		if (term->sgr[i] != 0)
+			codes |= 1 << i;
+	}
+	attr = gc->attr & codes;
+	cleared = tc->attr & codes & ~attr;
+	added = attr & ~tc->attr;
+
+	fg_changed = gc->fg != tc->fg ||
+	    ((gc->flags ^ tc->flags) & GRID_FLAG_FG256);
+	bg_changed = gc->bg != tc->bg ||
+	    ((gc->flags ^ tc->flags) & GRID_FLAG_BG256);
+	fg_default = (gc->fg == 8 && !(gc->flags & GRID_FLAG_FG256));
+	bg_default = (gc->bg == 8 && !(gc->flags & GRID_FLAG_BG256));
+
+	/*
+	 * Attributes can only be cleared separately if they use the standard
+	 * parameters and colours only set to default with AX.
+	 */
+	use_delta = 1;
+	for (i = 0; i < nitems(term->sgr); i++) {
+		if ((cleared & (1 << i)) && term->sgr[i] != tty_sgr_on[i])
+			use_delta = 0;
+	}
+	have_ax = tty_term_has(term, TTYC_AX);
+	if (!have_ax && ((fg_changed && fg_default) ||
+	    (bg_changed && bg_default)))
+		use_delta = 0;
+
+	*delta = '\0';
+	if (use_delta) {
+		/*
+		 * Clear attributes. Some parameters clear more than one (22 is
+		 * both bright and dim) so any which are kept but were cleared
+		 * as well need to be set again.
+		 */
+		for (i = 0; i < nitems(term->sgr); i++) {
+			if (!(cleared & (1 << i)))
+				continue;
+			for (j = 0; j < i; j++) {
+				if ((cleared & (1 << j)) &&
+				    tty_sgr_off[j] == tty_sgr_off[i])
+					break;
+			}
+			if (j == i)
+				tty_sgr_add(delta, sizeof delta,
+				    tty_sgr_off[i]);
+			for (j = 0; j < nitems(term->sgr); j++) {
+				if (!(attr & (1 << j)))
+					continue;
+				if (tty_sgr_off[j] == tty_sgr_off[i] ||
+				    term->sgr[j] == tty_sgr_on[i])
+					added |= 1 << j;
+			}
+		}
+		for (i = 0; i < nitems(term->sgr); i++) {
+			if (added & (1 << i))
+				tty_sgr_add(delta, sizeof delta, term->sgr[i]);
+		}
+		if (fg_changed) {
+			tty_sgr_colour(tty, delta, sizeof delta, gc->fg,
+			    gc->flags & GRID_FLAG_FG256, 0);
+		}
+		if (bg_changed) {
+			tty_sgr_colour(tty, delta, sizeof delta, gc->bg,
+			    gc->flags & GRID_FLAG_BG256, 1);
+		}
+	}
+
+	/* Nothing changed? Only the character set might need to be sent. */
+	if (use_delta && *delta == '\0')
+		goto charset;
+
+	*reset = '\0';
+	tty_sgr_add(reset, sizeof reset, 0);
+	for (i = 0; i < nitems(term->sgr); i++) {
+		if (attr & (1 << i))
+			tty_sgr_add(reset, sizeof reset, term->sgr[i]);
+	}
+	if (!fg_default) {
+		tty_sgr_colour(tty, reset, sizeof reset, gc->fg,
+		    gc->flags & GRID_FLAG_FG256, 0);
+	}
+	if (!bg_default) {
+		tty_sgr_colour(tty, reset, sizeof reset, gc->bg,
+		    gc->flags & GRID_FLAG_BG256, 1);
+	}
+	if (strcmp(reset, "0") == 0)
+		*reset = '\0';
+
+	if (use_delta && strlen(delta) <= strlen(reset))
+		xsnprintf(s, sizeof s, "\033[%sm", delta);
+	else
+		xsnprintf(s, sizeof s, "\033[%sm", reset);
+	tty_puts(tty, s);
+
+charset:
+	if (tty_use_acs(tty)) {
+		if ((tc->attr & GRID_ATTR_CHARSET) &&
+		    !(gc->attr & GRID_ATTR_CHARSET))
+			tty_putcode(tty, TTYC_RMACS);
+		if (!(tc->attr & GRID_ATTR_CHARSET) &&
+		    (gc->attr & GRID_ATTR_CHARSET))
+			tty_putcode(tty, TTYC_SMACS);
+	}
+
+	tc->attr = gc->attr;
+	tc->fg = gc->fg;
+	tc->bg = gc->bg;
+	tc->flags &= ~(GRID_FLAG_FG256|GRID_FLAG_BG256);
+	tc->flags |= gc->flags & (GRID_FLAG_FG256|GRID_FLAG_BG256);
+}
+
+/* Add a parameter to an SGR sequence. */
+void
+tty_sgr_add(char *buf, size_t len, u_int n)
+{
+	char	tmp[8];
+
+	xsnprintf(tmp, sizeof tmp, "%s%u", *buf == '\0' ? "" : ";", n);
+	strlcat(buf, tmp, len);
+}
+
+/* Add the parameters for a colour to an SGR sequence, like tty_colours_fg. */
+void
+tty_sgr_colour(struct tty *tty, char *buf, size_t len, u_char colour,
+    int is256, int bg)
+{
+	if (is256) {
+		if (!(tty->term->flags & TERM_256COLOURS) &&
+		    !(tty->term_flags & TERM_256COLOURS))
+			colour = colour_256to88(colour);
+		tty_sgr_add(buf, len, bg ? 48 : 38);
+		tty_sgr_add(buf, len, 5);
+		tty_sgr_add(buf, len, colour);
+		return;
+	}
+
+	if (colour == 8)
+		tty_sgr_add(buf, len, bg ? 49 : 39);
+	else if (colour >= 90 && colour <= 97) {
+		if (!bg)
+			tty_sgr_add(buf, len, colour);
+		else if (tty_term_number(tty->term, TTYC_COLORS) >= 16)
+			tty_sgr_add(buf, len, colour + 10);
+		else
+			tty_sgr_add(buf, len, 40 + colour - 90);
+	} else
+		tty_sgr_add(buf, len, (bg ? 40 : 30) + colour);
+}
+
 void
 tty_colours(struct tty *tty, const struct grid_cell *gc)
 {
@@ -248,6 +248,7 @@ window_copy_free(struct window_pane *wp)
 		free(data->backing);
 	}
 	screen_free(&data->screen);
+	grid_compress_history(wp->base.grid);
 
 	free(data);
 }
@@ -908,7 +909,6 @@ window_copy_search_compare(
     struct grid *gd, u_int px, u_int py, struct grid *sgd, u_int spx)
 {
 	const struct grid_cell	*gc, *sgc;
-	const struct grid_utf8	*gu, *sgu;
 
 	gc = grid_peek_cell(gd, px, py);
 	sgc = grid_peek_cell(sgd, spx, 0);
@@ -916,15 +916,9 @@ window_copy_search_compare(
 	if ((gc->flags & GRID_FLAG_UTF8) != (sgc->flags & GRID_FLAG_UTF8))
 		return (0);
 
-	if (gc->flags & GRID_FLAG_UTF8) {
-		gu = grid_peek_utf8(gd, px, py);
-		sgu = grid_peek_utf8(sgd, spx, 0);
-		if (grid_utf8_compare(gu, sgu))
-			return (1);
-	} else {
-		if (gc->data == sgc->data)
-			return (1);
-	}
+	/* UTF-8 characters are shared, so the same data means the same cell. */
+	if (gc->data == sgc->data)
+		return (1);
 	return (0);
 }
 
@@ -934,6 +928,8 @@ window_copy_search_lr(struct grid *gd,
 {
 	u_int	ax, bx, px;
 
+	if (!grid_may_contain(gd, py, sgd))
+		return (0);
 	for (ax = first; ax < last; ax++) {
 		if (ax + sgd->sx >= gd->sx)
 			break;
@@ -956,6 +952,8 @@ window_copy_search_rl(struct grid *gd,
 {
 	u_int	ax, bx, px;
 
+	if (!grid_may_contain(gd, py, sgd))
+		return (0);
 	for (ax = last + 1; ax > first; ax--) {
 		if (gd->sx - (ax - 1) < sgd->sx)
 			continue;
@@ -1026,6 +1024,7 @@ retry:
 		wrapped = 1;
 		goto retry;
 	}
+	grid_compress_history(gd);
 
 	screen_free(&ss);
 }
@@ -1084,6 +1083,7 @@ retry:
 		wrapped = 1;
 		goto retry;
 	}
+	grid_compress_history(gd);
 
 	screen_free(&ss);
 }
@@ -1395,7 +1395,7 @@ window_copy_copy_line(struct window_pane *wp,
 	struct window_copy_mode_data	*data = wp->modedata;
 	struct grid			*gd = data->backing->grid;
 	const struct grid_cell		*gc;
-	const struct grid_utf8		*gu;
+	struct grid_utf8		 gu;
 	struct grid_line		*gl;
 	u_int				 i, xx, wrapped = 0;
 	size_t				 size;
@@ -1407,7 +1407,7 @@ window_copy_copy_line(struct window_pane *wp,
 	 * Work out if the line was wrapped at the screen edge and all of it is
 	 * on screen.
 	 */
-	gl = &gd->linedata[sy];
+	gl = grid_get_line(gd, sy);
 	if (gl->flags & GRID_LINE_WRAPPED && gl->cellsize <= gd->sx)
 		wrapped = 1;
 
@@ -1430,10 +1430,10 @@ window_copy_copy_line(struct window_pane *wp,
 				*buf = xrealloc(*buf, 1, (*off) + 1);
 				(*buf)[(*off)++] = gc->data;
 			} else {
-				gu = grid_peek_utf8(gd, i, sy);
-				size = grid_utf8_size(gu);
+				grid_utf8_get(gc, &gu);
+				size = grid_utf8_size(&gu);
 				*buf = xrealloc(*buf, 1, (*off) + size);
-				*off += grid_utf8_copy(gu, *buf + *off, size);
+				*off += grid_utf8_copy(&gu, *buf + *off, size);
 			}
 		}
 	}
@@ -1487,7 +1487,7 @@ window_copy_find_length(struct window_pane *wp, u_int py)
 	 * width of the grid, and screen_write_copy treats them as spaces, so
 	 * ignore them here too.
 	 */
-	px = s->grid->linedata[py].cellsize;
+	px = grid_peek_line(s->grid, py)->cellsize;
 	if (px > screen_size_x(s))
 		px = screen_size_x(s);
 	while (px > 0) {
@@ -1511,7 +1511,8 @@ window_copy_cursor_start_of_line(struct window_pane *wp)
 
 	if (data->cx == 0) {
 		py = screen_hsize(back_s) + data->cy - data->oy;
-		while (py > 0 && gd->linedata[py-1].flags & GRID_LINE_WRAPPED) {
+		while (py > 0 &&
+		    grid_peek_line(gd, py - 1)->flags & GRID_LINE_WRAPPED) {
 			window_copy_cursor_up(wp, 0);
 			py = screen_hsize(back_s) + data->cy - data->oy;
 		}
@@ -1560,9 +1561,9 @@ window_copy_cursor_end_of_line(struct window_pane *wp)
 	if (data->cx == px) {
 		if (data->screen.sel.flag && data->rectflag)
 			px = screen_size_x(back_s);
-		if (gd->linedata[py].flags & GRID_LINE_WRAPPED) {
+		if (grid_peek_line(gd, py)->flags & GRID_LINE_WRAPPED) {
 			while (py < gd->sy + gd->hsize &&
-			    gd->linedata[py].flags & GRID_LINE_WRAPPED) {
+			    grid_peek_line(gd, py)->flags & GRID_LINE_WRAPPED) {
 				window_copy_cursor_down(wp, 0);
 				py = screen_hsize(back_s)
 				     + data->cy - data->oy;
@@ -1705,7 +1706,7 @@ window_copy_cursor_jump(struct window_pane *wp)
 	while (px < xx) {
 		gc = grid_peek_cell(back_s->grid, px, py);
 		if ((gc->flags & (GRID_FLAG_PADDING|GRID_FLAG_UTF8)) == 0
-		    && gc->data == data->jumpchar) {
+		    && gc->data == (u_char)data->jumpchar) {
 
 			window_copy_update_cursor(wp, px, data->cy);
 			if (window_copy_update_selection(wp))
@@ -1733,7 +1734,7 @@ window_copy_cursor_jump_back(struct window_pane *wp)
 	for (;;) {
 		gc = grid_peek_cell(back_s->grid, px, py);
 		if ((gc->flags & (GRID_FLAG_PADDING|GRID_FLAG_UTF8)) == 0
-		    && gc->data == data->jumpchar) {
+		    && gc->data == (u_char)data->jumpchar) {
 
 			window_copy_update_cursor(wp, px, data->cy);
 			if (window_copy_update_selection(wp))
@@ -1761,7 +1762,7 @@ window_copy_cursor_jump_to(struct window_pane *wp)
 	while (px < xx) {
 		gc = grid_peek_cell(back_s->grid, px, py);
 		if ((gc->flags & (GRID_FLAG_PADDING|GRID_FLAG_UTF8)) == 0
-		    && gc->data == data->jumpchar) {
+		    && gc->data == (u_char)data->jumpchar) {
 
 			window_copy_update_cursor(wp, px - 1, data->cy);
 			if (window_copy_update_selection(wp))
@@ -1789,7 +1790,7 @@ window_copy_cursor_jump_to_back(struct window_pane *wp)
 	for (;;) {
 		gc = grid_peek_cell(back_s->grid, px, py);
 		if ((gc->flags & (GRID_FLAG_PADDING|GRID_FLAG_UTF8)) == 0
-		    && gc->data == data->jumpchar) {
+		    && gc->data == (u_char)data->jumpchar) {
 
 			window_copy_update_cursor(wp, px + 1, data->cy);
 			if (window_copy_update_selection(wp))
@@ -47,17 +47,33 @@
  * Windows are stored directly on a global array and wrapped in any number of
  * winlink structs to be linked onto local session RB trees. A reference count
  * is maintained and a window removed from the global list and destroyed when
- * it reaches zero.
+ * it reaches zero. Each window also keeps a list of the winlinks pointing to
+ * it, so the sessions containing it can be found without searching them all.
  */
 
-/* Global window list. */
+/* Global window list and tree by id. */
 struct windows windows;
+struct window_tree all_windows;
 
-/* Global panes tree. */
+/* Global panes tree, and tree of panes with a running process by pid. */
 struct window_pane_tree all_window_panes;
+struct window_pane_pid_tree all_window_pane_pids;
+
+/*
+ * Panes waiting for the next check of how much they are changing. These share
+ * one timer, so a flood of output in many panes doesn't mean a timer for each.
+ */
+TAILQ_HEAD(, window_pane) window_pane_changes =
+    TAILQ_HEAD_INITIALIZER(window_pane_changes);
+struct event window_pane_changes_timer;
+
+/* Panes in a mode which needs a timer once a second. */
+TAILQ_HEAD(, window_pane) window_pane_timers =
+    TAILQ_HEAD_INITIALIZER(window_pane_timers);
 u_int	next_window_pane_id;
 u_int	next_window_id;
 
+void	window_map_build(struct window *);
 void	window_pane_timer_callback(int, short, void *);
 void	window_pane_read_callback(struct bufferevent *, void *);
 void	window_pane_error_callback(struct bufferevent *, short, void *);
@@ -70,6 +86,14 @@ winlink_cmp(struct winlink *wl1, struct winlink *wl2)
 	return (wl1->idx - wl2->idx);
 }
 
+RB_GENERATE(window_tree, window, tree_entry, window_cmp);
+
+int
+window_cmp(struct window *w1, struct window *w2)
+{
+	return (w1->id - w2->id);
+}
+
 RB_GENERATE(window_pane_tree, window_pane, tree_entry, window_pane_cmp);
 
 int
@@ -78,6 +102,14 @@ window_pane_cmp(struct window_pane *wp1, struct window_pane *wp2)
 	return (wp1->id - wp2->id);
 }
 
+RB_GENERATE(window_pane_pid_tree, window_pane, pid_entry, window_pane_pid_cmp);
+
+int
+window_pane_pid_cmp(struct window_pane *wp1, struct window_pane *wp2)
+{
+	return (wp1->pid - wp2->pid);
+}
+
 struct winlink *
 winlink_find_by_window(struct winlinks *wwl, struct window *w)
 {
@@ -167,6 +199,7 @@ void
 winlink_set_window(struct winlink *wl, struct window *w)
 {
 	wl->window = w;
+	TAILQ_INSERT_TAIL(&w->winlinks, wl, wentry);
 	w->references++;
 }
 
@@ -176,6 +209,8 @@ winlink_remove(struct winlinks *wwl, struct winlink *wl)
 	struct window	*w = wl->window;
 
 	RB_REMOVE(winlinks, wwl, wl);
+	if (w != NULL)
+		TAILQ_REMOVE(&w->winlinks, wl, wentry);
 	free(wl->status_text);
 	free(wl);
 
@@ -256,15 +291,10 @@ window_index(struct window *s, u_int *i)
 struct window *
 window_find_by_id(u_int id)
 {
-	struct window	*w;
-	u_int		 i;
+	struct window	w;
 
-	for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
-		w = ARRAY_ITEM(&windows, i);
-		if (w->id == id)
-			return (w);
-	}
-	return (NULL);
+	w.id = id;
+	return (RB_FIND(window_tree, &all_windows, &w));
 }
 
 struct window *
@@ -275,11 +305,14 @@ window_create1(u_int sx, u_int sy)
 
 	w = xcalloc(1, sizeof *w);
 	w->id = next_window_id++;
+	RB_INSERT(window_tree, &all_windows, w);
 	w->name = NULL;
 	w->flags = 0;
 
 	TAILQ_INIT(&w->panes);
 	w->active = NULL;
+	ARRAY_INIT(&w->clients);
+	TAILQ_INIT(&w->winlinks);
 
 	w->lastlayout = -1;
 	w->layout_root = NULL;
@@ -339,17 +372,18 @@ window_destroy(struct window *w)
 	ARRAY_SET(&windows, i, NULL);
 	while (!ARRAY_EMPTY(&windows) && ARRAY_LAST(&windows) == NULL)
 		ARRAY_TRUNC(&windows, 1);
+	RB_REMOVE(window_tree, &all_windows, w);
 
 	if (w->layout_root != NULL)
 		layout_free(w);
 
-	if (event_initialized(&w->name_timer))
-		evtimer_del(&w->name_timer);
+	server_window_unqueue(w);
 
 	options_free(&w->options);
 
 	window_destroy_panes(w);
 
+	ARRAY_FREE(&w->clients);
 	free(w->name);
 	free(w);
 }
@@ -377,6 +411,67 @@ window_resize(struct window *w, u_int sx, u_int sy)
 {
 	w->sx = sx;
 	w->sy = sy;
+	window_map_invalidate(w);
+}
+
+/* Discard the cell map after the panes have changed. */
+void
+window_map_invalidate(struct window *w)
+{
+	free(w->map);
+	w->map = NULL;
+	free(w->map_panes);
+	w->map_panes = NULL;
+}
+
+/*
+ * Build the cell map. It covers one more column and row than the window since
+ * panes at the right and bottom edges have their borders there. Panes earlier
+ * in the list take priority where they overlap, so they are filled in last.
+ */
+void
+window_map_build(struct window *w)
+{
+	struct window_pane	*wp;
+	u_int			 mx, x, y, left, top;
+	u_char			*cell;
+
+	mx = w->sx + 1;
+	w->map = xcalloc(mx * (w->sy + 1), sizeof *w->map);
+	w->map_panes = xcalloc(mx * (w->sy + 1), sizeof *w->map_panes);
+
+	TAILQ_FOREACH_REVERSE(wp, &w->panes, window_panes, entry) {
+		if (!window_pane_visible(wp))
+			continue;
+		left = wp->xoff == 0 ? 0 : wp->xoff - 1;
+		top = wp->yoff == 0 ? 0 : wp->yoff - 1;
+
+		for (y = top; y <= wp->yoff + wp->sy; y++) {
+			for (x = left; x <= wp->xoff + wp->sx; x++) {
+				cell = &w->map[y * mx + x];
+				if (x < wp->xoff || x == wp->xoff + wp->sx ||
+				    y < wp->yoff || y == wp->yoff + wp->sy)
+					*cell = WINDOW_MAP_BORDER;
+				else
+					*cell = WINDOW_MAP_INSIDE;
+
+				/* Owns its right and bottom borders. */
+				if (x >= wp->xoff && y >= wp->yoff)
+					w->map_panes[y * mx + x] = wp;
+			}
+		}
+	}
+}
+
+/* Get whether a cell is inside a pane, on a border or outside all panes. */
+int
+window_map_cell(struct window *w, u_int x, u_int y)
+{
+	if (x > w->sx || y > w->sy)
+		return (WINDOW_MAP_OUTSIDE);
+	if (w->map == NULL)
+		window_map_build(w);
+	return (w->map[y * (w->sx + 1) + x]);
 }
 
 void
@@ -398,18 +493,11 @@ window_set_active_pane(struct window *w, struct window_pane *wp)
 struct window_pane *
 window_get_active_at(struct window *w, u_int x, u_int y)
 {
-	struct window_pane	*wp;
-
-	TAILQ_FOREACH(wp, &w->panes, entry) {
-		if (!window_pane_visible(wp))
-			continue;
-		if (x < wp->xoff || x > wp->xoff + wp->sx)
-			continue;
-		if (y < wp->yoff || y > wp->yoff + wp->sy)
-			continue;
-		return (wp);
-	}
-	return (NULL);
+	if (x > w->sx || y > w->sy)
+		return (NULL);
+	if (w->map == NULL)
+		window_map_build(w);
+	return (w->map_panes[y * (w->sx + 1) + x]);
 }
 
 void
@@ -466,6 +554,7 @@ window_add_pane(struct window *w, u_int hlimit)
 		TAILQ_INSERT_HEAD(&w->panes, wp, entry);
 	else
 		TAILQ_INSERT_AFTER(&w->panes, w->active, wp, entry);
+	window_map_invalidate(w);
 	return (wp);
 }
 
@@ -484,6 +573,7 @@ window_remove_pane(struct window *w, struct window_pane *wp)
 		w->last = NULL;
 
 	TAILQ_REMOVE(&w->panes, wp, entry);
+	window_map_invalidate(w);
 	window_pane_destroy(wp);
 }
 
@@ -564,6 +654,7 @@ window_destroy_panes(struct window *w)
 		TAILQ_REMOVE(&w->panes, wp, entry);
 		window_pane_destroy(wp);
 	}
+	window_map_invalidate(w);
 }
 
 /* Return list of printable window flag symbols. No flags is just a space. */
@@ -602,6 +693,24 @@ window_pane_find_by_id(u_int id)
 	return (RB_FIND(window_pane_tree, &all_window_panes, &wp));
 }
 
+/* Find pane by the pid of its running process. */
+struct window_pane *
+window_pane_find_by_pid(pid_t pid)
+{
+	struct window_pane	wp;
+
+	wp.pid = pid;
+	return (RB_FIND(window_pane_pid_tree, &all_window_pane_pids, &wp));
+}
+
+/* Remove pane from the pid tree if it is there. */
+void
+window_pane_remove_pid(struct window_pane *wp)
+{
+	if (window_pane_find_by_pid(wp->pid) == wp)
+		RB_REMOVE(window_pane_pid_tree, &all_window_pane_pids, wp);
+}
+
 struct window_pane *
 window_pane_create(struct window *w, u_int sx, u_int sy, u_int hlimit)
 {
@@ -637,6 +746,8 @@ window_pane_create(struct window *w, u_int sx, u_int sy, u_int hlimit)
 	wp->saved_grid = NULL;
 
 	screen_init(&wp->base, sx, sy, hlimit);
+	wp->base.grid->hhot =
+	    options_get_number(&w->options, "history-hot-limit");
 	wp->screen = &wp->base;
 
 	input_init(wp);
@@ -649,8 +760,8 @@ window_pane_destroy(struct window_pane *wp)
 {
 	window_pane_reset_mode(wp);
 
-	if (event_initialized(&wp->changes_timer))
-		evtimer_del(&wp->changes_timer);
+	if (wp->flags & PANE_CHANGESQUEUED)
+		TAILQ_REMOVE(&window_pane_changes, wp, changes_entry);
 
 	if (wp->fd != -1) {
 		bufferevent_free(wp->event);
@@ -669,6 +780,7 @@ window_pane_destroy(struct window_pane *wp)
 	}
 
 	RB_REMOVE(window_pane_tree, &all_window_panes, wp);
+	window_pane_remove_pid(wp);
 
 	free(wp->cwd);
 	free(wp->shell);
@@ -706,6 +818,7 @@ window_pane_spawn(struct window_pane *wp, const char *cmd, const char *shell,
 	ws.ws_col = screen_size_x(&wp->base);
 	ws.ws_row = screen_size_y(&wp->base);
 
+	window_pane_remove_pid(wp);
 	switch (wp->pid = forkpty(&wp->fd, wp->tty, NULL, &ws)) {
 	case -1:
 		wp->fd = -1;
@@ -758,6 +871,7 @@ window_pane_spawn(struct window_pane *wp, const char *cmd, const char *shell,
 		fatal("execl failed");
 	}
 
+	RB_INSERT(window_pane_pid_tree, &all_window_pane_pids, wp);
 	setblocking(wp->fd, 0);
 
 	wp->event = bufferevent_new(wp->fd,
@@ -772,36 +886,70 @@ window_pane_timer_start(struct window_pane *wp)
 {
 	struct timeval	tv;
 
-	tv.tv_sec = 0;
-	tv.tv_usec = 1000;
+	if (wp->flags & PANE_CHANGESQUEUED)
+		return;
+	TAILQ_INSERT_TAIL(&window_pane_changes, wp, changes_entry);
+	wp->flags |= PANE_CHANGESQUEUED;
 
-	evtimer_del(&wp->changes_timer);
-	evtimer_set(&wp->changes_timer, window_pane_timer_callback, wp);
-	evtimer_add(&wp->changes_timer, &tv);
+	if (!event_initialized(&window_pane_changes_timer)) {
+		evtimer_set(&window_pane_changes_timer,
+		    window_pane_timer_callback, NULL);
+	}
+	if (!evtimer_pending(&window_pane_changes_timer, NULL)) {
+		tv.tv_sec = 0;
+		tv.tv_usec = 1000;
+		evtimer_add(&window_pane_changes_timer, &tv);
+	}
 }
 
+/* ARGSUSED */
 void
-window_pane_timer_callback(unused int fd, unused short events, void *data)
+window_pane_timer_callback(
+    unused int fd, unused short events, unused void *data)
 {
-	struct window_pane	*wp = data;
-	struct window		*w = wp->window;
-	u_int			 interval, trigger;
+	TAILQ_HEAD(, window_pane)	 panes;
+	struct window_pane		*wp;
+	struct window			*w;
+	u_int				 interval, trigger;
+
+	/* Panes still changing are queued again for the next tick. */
+	TAILQ_INIT(&panes);
+	while ((wp = TAILQ_FIRST(&window_pane_changes)) != NULL) {
+		TAILQ_REMOVE(&window_pane_changes, wp, changes_entry);
+		wp->flags &= ~PANE_CHANGESQUEUED;
+		TAILQ_INSERT_TAIL(&panes, wp, changes_entry);
+	}
 
-	interval = options_get_number(&w->options, "c0-change-interval");
-	trigger = options_get_number(&w->options, "c0-change-trigger");
+	while ((wp = TAILQ_FIRST(&panes)) != NULL) {
+		TAILQ_REMOVE(&panes, wp, changes_entry);
+		w = wp->window;
 
-	if (wp->changes_redraw++ == interval) {
-		wp->flags |= PANE_REDRAW;
-		wp->changes_redraw = 0;
+		interval = options_get_number(&w->options,
+		    "c0-change-interval");
+		trigger = options_get_number(&w->options, "c0-change-trigger");
 
+		if (wp->changes_redraw++ == interval) {
+			wp->flags |= PANE_CHANGED;
+			wp->changes_redraw = 0;
+		}
+
+		if (trigger == 0 || wp->changes < trigger) {
+			wp->flags |= PANE_CHANGED;
+			wp->flags &= ~PANE_DROP;
+		} else
+			window_pane_timer_start(wp);
+		wp->changes = 0;
 	}
+}
 
-	if (trigger == 0 || wp->changes < trigger) {
-		wp->flags |= PANE_REDRAW;
-		wp->flags &= ~PANE_DROP;
-	} else
-		window_pane_timer_start(wp);
-	wp->changes = 0;
+/* Run the timer for every pane in a mode which has one. */
+void
+window_pane_mode_timers(void)
+{
+	struct window_pane	*wp;
+
+	TAILQ_FOREACH(wp, &window_pane_timers, timer_entry)
+		wp->mode->timer(wp);
 }
 
 /* ARGSUSED */
@@ -822,13 +970,10 @@ window_pane_read_callback(unused struct bufferevent *bufev, void *data)
 
 	wp->pipe_off = EVBUFFER_LENGTH(wp->event->input);
 
-	/*
-	 * If we get here, we're not outputting anymore, so set the silence
-	 * flag on the window.
-	 */
-	wp->window->flags |= WINDOW_SILENCE;
-	if (gettimeofday(&wp->window->silence_timer, NULL) != 0)
-		fatal("gettimeofday failed.");
+	/* The name may have changed if the window has had output. */
+	wp->window->flags |= WINDOW_NAMEOUTPUT;
+
+	server_window_output(wp->window);
 }
 
 /* ARGSUSED */
@@ -846,6 +991,7 @@ window_pane_resize(struct window_pane *wp, u_int sx, u_int sy)
 {
 	struct winsize	ws;
 
+	window_map_invalidate(wp->window);
 	if (sx == wp->sx && sy == wp->sy)
 		return;
 	wp->sx = sx;
@@ -959,6 +1105,11 @@ window_pane_set_mode(struct window_pane *wp, const struct window_mode *mode)
 	if ((s = wp->mode->init(wp)) != NULL)
 		wp->screen = s;
 	wp->flags |= PANE_REDRAW;
+
+	if (wp->mode->timer != NULL) {
+		TAILQ_INSERT_TAIL(&window_pane_timers, wp, timer_entry);
+		wp->flags |= PANE_MODETIMER;
+	}
 	return (0);
 }
 
@@ -968,6 +1119,10 @@ window_pane_reset_mode(struct window_pane *wp)
 	if (wp->mode == NULL)
 		return;
 
+	if (wp->flags & PANE_MODETIMER) {
+		TAILQ_REMOVE(&window_pane_timers, wp, timer_entry);
+		wp->flags &= ~PANE_MODETIMER;
+	}
 	wp->mode->free(wp);
 	wp->mode = NULL;
 
@@ -1061,12 +1216,48 @@ window_pane_search(struct window_pane *wp, const char *searchstr, u_int *lineno)
 	return (msg);
 }
 
+/*
+ * Search only the lines which have changed since the pane was last searched.
+ * The caller marks them as searched afterwards. A string without any pattern
+ * characters is looked for directly rather than with fnmatch.
+ */
+int
+window_pane_search_changed(struct window_pane *wp, const char *searchstr)
+{
+	struct screen	*s = &wp->base;
+	char		*newsearchstr, *line;
+	u_int		 i;
+	int		 literal, found;
+
+	literal = (searchstr[strcspn(searchstr, "*?[\\")] == '\0');
+	if (literal)
+		newsearchstr = NULL;
+	else
+		xasprintf(&newsearchstr, "*%s*", searchstr);
+
+	found = 0;
+	for (i = 0; i < screen_size_y(s); i++) {
+		if (!screen_line_unsearched(s, i))
+			continue;
+		line = grid_view_string_cells(s->grid, 0, i, screen_size_x(s));
+		if (literal)
+			found = (strstr(line, searchstr) != NULL);
+		else
+			found = (fnmatch(newsearchstr, line, 0) == 0);
+		free(line);
+		if (found)
+			break;
+	}
+
+	free(newsearchstr);
+	return (found);
+}
+
 /* Find the pane directly above another. */
 struct window_pane *
 window_pane_find_up(struct window_pane *wp)
 {
-	struct window_pane     *wp2;
-	u_int			left, top;
+	u_int	top;
 
 	if (wp == NULL || !window_pane_visible(wp))
 		return (NULL);
@@ -1074,25 +1265,16 @@ window_pane_find_up(struct window_pane *wp)
 	top = wp->yoff;
 	if (top == 0)
 		top = wp->window->sy + 1;
-	left = wp->xoff;
 
-	TAILQ_FOREACH(wp2, &wp->window->panes, entry) {
-		if (!window_pane_visible(wp2))
-			continue;
-		if (wp2->yoff + wp2->sy + 1 != top)
-			continue;
-		if (left >= wp2->xoff && left <= wp2->xoff + wp2->sx)
-			return (wp2);
-	}
-	return (NULL);
+	/* The pane above owns the border cell above the top-left corner. */
+	return (window_get_active_at(wp->window, wp->xoff, top - 1));
 }
 
 /* Find the pane directly below another. */
 struct window_pane *
 window_pane_find_down(struct window_pane *wp)
 {
-	struct window_pane     *wp2;
-	u_int			left, bottom;
+	u_int	bottom;
 
 	if (wp == NULL || !window_pane_visible(wp))
 		return (NULL);
@@ -1100,17 +1282,8 @@ window_pane_find_down(struct window_pane *wp)
 	bottom = wp->yoff + wp->sy + 1;
 	if (bottom >= wp->window->sy)
 		bottom = 0;
-	left = wp->xoff;
 
-	TAILQ_FOREACH(wp2, &wp->window->panes, entry) {
-		if (!window_pane_visible(wp2))
-			continue;
-		if (wp2->yoff != bottom)
-			continue;
-		if (left >= wp2->xoff && left <= wp2->xoff + wp2->sx)
-			return (wp2);
-	}
-	return (NULL);
+	return (window_get_active_at(wp->window, wp->xoff, bottom));
 }
 
 /*
@@ -1120,8 +1293,7 @@ window_pane_find_down(struct window_pane *wp)
 struct window_pane *
 window_pane_find_left(struct window_pane *wp)
 {
-	struct window_pane     *wp2;
-	u_int			left, top;
+	u_int	left;
 
 	if (wp == NULL || !window_pane_visible(wp))
 		return (NULL);
@@ -1129,17 +1301,8 @@ window_pane_find_left(struct window_pane *wp)
 	left = wp->xoff;
 	if (left == 0)
 		left = wp->window->sx + 1;
-	top = wp->yoff;
 
-	TAILQ_FOREACH(wp2, &wp->window->panes, entry) {
-		if (!window_pane_visible(wp2))
-			continue;
-		if (wp2->xoff + wp2->sx + 1 != left)
-			continue;
-		if (top >= wp2->yoff && top <= wp2->yoff + wp2->sy)
-			return (wp2);
-	}
-	return (NULL);
+	return (window_get_active_at(wp->window, left - 1, wp->yoff));
 }
 
 /*
@@ -1149,8 +1312,7 @@ window_pane_find_left(struct window_pane *wp)
 struct window_pane *
 window_pane_find_right(struct window_pane *wp)
 {
-	struct window_pane     *wp2;
-	u_int			right, top;
+	u_int	right;
 
 	if (wp == NULL || !window_pane_visible(wp))
 		return (NULL);
@@ -1158,44 +1320,27 @@ window_pane_find_right(struct window_pane *wp)
 	right = wp->xoff + wp->sx + 1;
 	if (right >= wp->window->sx)
 		right = 0;
-	top = wp->yoff;
 
-	TAILQ_FOREACH(wp2, &wp->window->panes, entry) {
-		if (!window_pane_visible(wp2))
-			continue;
-		if (wp2->xoff != right)
-			continue;
-		if (top >= wp2->yoff && top <= wp2->yoff + wp2->sy)
-			return (wp2);
-	}
-	return (NULL);
+	return (window_get_active_at(wp->window, right, wp->yoff));
 }
 
-/* Clear alert flags for a winlink */
+/*
+ * Clear alert flags for a winlink. The window is being looked at, so silence
+ * starts being timed again from now.
+ */
 void
 winlink_clear_flags(struct winlink *wl)
 {
 	struct winlink	*wm;
-	struct session	*s;
-	struct window	*w;
-	u_int		 i;
 
-	for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
-		if ((w = ARRAY_ITEM(&windows, i)) == NULL)
-			continue;
-
-		RB_FOREACH(s, sessions, &sessions) {
-			if ((wm = session_has(s, w)) == NULL)
-				continue;
+	server_window_reset_silence(wl->window);
 
-			if (wm->window != wl->window)
-				continue;
-			if ((wm->flags & WINLINK_ALERTFLAGS) == 0)
-				continue;
+	TAILQ_FOREACH(wm, &wl->window->winlinks, wentry) {
+		if ((wm->flags & WINLINK_ALERTFLAGS) == 0)
+			continue;
 
-			wm->flags &= ~WINLINK_ALERTFLAGS;
-			server_status_session(s);
-		}
+		wm->flags &= ~WINLINK_ALERTFLAGS;
+		server_status_session(wm->session);
 	}
 }
 